@@ -1,3 +1,17 @@
+#ifndef HW2_H
+#define HW2_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Exit codes of hw2_main for invalid command lines.
 #define MISSING_ARGUMENT 1
 #define UNRECOGNIZED_ARGUMENT 2
 #define DUPLICATE_ARGUMENT 3
@@ -7,3 +21,179 @@
 #define C_ARGUMENT_INVALID 7
 #define P_ARGUMENT_INVALID 8
 #define R_ARGUMENT_INVALID 9
+
+// Image library (libhw2). Functions that can fail return HW2_OK or one of the error codes
+// below and print nothing; hw2_error_message describes the last failure on the calling thread.
+#define HW2_OK 0
+#define HW2_ERROR_OPEN 1   // a file could not be opened
+#define HW2_ERROR_FORMAT 2 // unsupported file type or malformed contents
+#define HW2_ERROR_MEMORY 3 // an allocation failed
+#define HW2_ERROR_WRITE 4  // writing the output failed
+
+// Returns a one-line description of the last error on the calling thread.
+const char *hw2_error_message(void);
+
+typedef struct {
+    unsigned char r, g, b;
+} RGBPixel;
+
+// Region allocator for the memory of one job. Small allocations are carved out of shared
+// blocks and large ones get a block each; none is freed on its own. release_arena drops all of
+// them at once but keeps the blocks, so the next job reuses the same, already mapped memory;
+// free_arena returns the blocks. A zero-initialized Arena is empty. Threads that help with a
+// job allocate from child arenas of the job's arena, which are released and freed with it.
+typedef struct Arena {
+    struct ArenaBlock *small, *current, *large;
+    struct Arena *children;
+    int childCount;
+} Arena;
+
+void release_arena(Arena *arena);
+void free_arena(Arena *arena);
+
+// pixels points either into buffer, a malloc'd array of capacity pixels that is kept from one
+// load to the next so a batch of jobs reuses it, or, for raw PPM input, into a private file
+// mapping that the image owns (mapping != NULL) of the file mappedDevice / mappedInode.
+// release_image drops the current pixels but keeps the buffer; free_image releases everything.
+// A zero-initialized Image is empty.
+//
+// With arena set, loads take their pixels from the arena instead of buffer, and the color
+// tables, palettes and other temporaries of the calls on this image come from it as well;
+// they all stay valid until the arena is released.
+typedef struct {
+    int width, height;
+    RGBPixel *pixels;
+    RGBPixel *buffer;
+    size_t capacity;
+    void *mapping;
+    size_t mappingSize;
+    dev_t mappedDevice;
+    ino_t mappedInode;
+    Arena *arena;
+} Image;
+
+typedef struct {
+    int row, col, width, height;
+} Rect;
+
+void release_image(Image *image);
+void free_image(Image *image);
+
+// Sets the size of image and points its pixels at an uninitialized buffer of that size.
+int allocate_image(Image *image, int width, int height);
+
+// Loaders pick the format from the file extension (load_image) or take it as given. With
+// writable set, raw PPM pixels may be a private mapping of the file that the caller can modify
+// without touching the file.
+int load_image(const char *filename, Image *image, bool writable);
+int load_ppm(const char *filename, Image *image, bool writable);
+int load_sbu(const char *filename, Image *image);
+
+// save_image picks the format from the extension; rawPpm selects binary P6 over plain P3.
+int save_image(const char *filename, Image *image, bool rawPpm);
+int save_ppm(const char *filename, Image *image);
+int save_ppm_raw(const char *filename, Image *image);
+int save_sbu(const char *filename, Image *image);
+
+// Stores the distinct colors of image in order of first appearance in *palette, which comes
+// from image->arena when set and is malloc'd otherwise. Unlike the functions above it returns
+// the number of colors, also stored in *paletteSize, or -1 when an allocation fails.
+int calculate_color_palette(Image *image, RGBPixel **palette, int *paletteSize);
+
+// Copies the region source to the top-left corner (destRow, destCol), clipped to the image.
+void blit_region(Image *image, Rect source, int destRow, int destCol);
+
+// Caps the threads that the library calls made on the calling thread use, the calling thread
+// included; 0 restores the default of one per online processor. Meant for callers that already
+// run several jobs side by side.
+void hw2_set_thread_budget(int threads);
+
+#define GLYPH_COUNT 26
+
+// A font parsed and scaled for one size. Every glyph keeps its unscaled rows, each stored as a
+// bitmask of the horizontally scaled pixels (bit x of word x / 64), wordsPerRow words per row;
+// glyph g's row r starts at bits[(g * rows + r) * wordsPerRow]. Rows are repeated scale times
+// when drawn, so the atlas stays a few kilobytes even at scale 10. For drawing, each row is
+// also kept as its runs of set pixels: glyph g's row r owns spans[rowSpans[g * rows + r]] up
+// to spans[rowSpans[g * rows + r + 1]].
+typedef struct {
+    uint16_t start, length;
+} GlyphSpan;
+
+typedef struct {
+    int rows, scale, wordsPerRow;
+    int widths[GLYPH_COUNT];
+    uint64_t *bits;
+    GlyphSpan *spans;
+    int *rowSpans;
+} GlyphAtlas;
+
+// Loads the ASCII-art font at fontPath scaled by scale, from the on-disk atlas cache if possible.
+int load_glyph_atlas(const char *fontPath, int scale, GlyphAtlas *atlas);
+void free_glyph_atlas(GlyphAtlas *atlas);
+
+// Draws message in white with its top-left corner at (row, col).
+void render_text(Image *image, const GlyphAtlas *atlas, const char *message, int row, int col);
+
+// Edits for convert_streaming, made in the order hw2_main makes them on a loaded image: with
+// copy set, source is pasted at (pasteRow, pasteCol) as blit_region does; then, unless atlas
+// is NULL, message is drawn at (textRow, textCol) as render_text does.
+typedef struct {
+    bool copy;
+    Rect source;
+    int pasteRow, pasteCol;
+    const GlyphAtlas *atlas;
+    const char *message;
+    int textRow, textCol;
+} StreamEdits;
+
+// Converts inputFile to outputFile a band of rows at a time, without holding the whole image,
+// making edits (if not NULL) on each band. Besides the band only the copied region is kept.
+// The band and palette come from arena when it is not NULL and stay valid until it is released.
+int convert_streaming(const char *inputFile, const char *outputFile, bool rawPpm, const StreamEdits *edits,
+                      Arena *arena);
+
+// Stages of a job that statistics are broken down by.
+typedef enum {
+    HW2_STAGE_NONE = -1,
+    HW2_STAGE_ARGUMENTS,  // command line validation (hw2_main)
+    HW2_STAGE_LOAD,       // opening, reading and decoding the input
+    HW2_STAGE_COPY_PASTE,
+    HW2_STAGE_RENDER,     // loading fonts and drawing text
+    HW2_STAGE_PALETTE,
+    HW2_STAGE_ENCODE,     // formatting the output
+    HW2_STAGE_WRITE,      // handing formatted output to the file
+    HW2_STAGE_COUNT
+} Hw2Stage;
+
+// Per-stage wall and CPU time and counters of the library calls made on one thread. CPU time
+// includes the helper threads a call starts. The peak heap is that of the whole process, as
+// seen at stage changes.
+typedef struct {
+    double wallSeconds[HW2_STAGE_COUNT], cpuSeconds[HW2_STAGE_COUNT];
+    uint64_t bytesRead, bytesWritten, pixels, rleRuns;
+    int paletteSize;
+    size_t peakHeapBytes;
+    // Current stage and the clocks at the last stage change.
+    int stage;
+    double stageWall, stageCpu;
+} Hw2Stats;
+
+// Clears stats and collects into it on the calling thread until hw2_stats_stop. When no
+// statistics are being collected the library's instrumentation is a thread-local test per call.
+void hw2_stats_start(Hw2Stats *stats);
+void hw2_stats_stop(void);
+
+// Makes stage the current stage of the statistics being collected and returns the previous
+// one, so a caller can time its own steps and restore the stage afterwards. Does nothing and
+// returns HW2_STAGE_NONE when no statistics are being collected.
+int hw2_stats_stage(int stage);
+
+// Prints stats as one line of JSON.
+void hw2_stats_print(const Hw2Stats *stats, FILE *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
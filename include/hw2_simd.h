@@ -0,0 +1,51 @@
+#ifndef HW2_SIMD_H
+#define HW2_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Vector kernels for packed RGB pixel data (3 bytes per pixel, r g b) and for decimal text.
+// Each kernel has a scalar version and, on x86, SSE2 and AVX2 versions; the best one the CPU
+// supports is picked at startup. All versions of a kernel give identical results.
+
+#define HW2_SIMD_SCALAR 0
+#define HW2_SIMD_SSE2 1
+#define HW2_SIMD_AVX2 2
+
+// Returns the kernel level in use.
+int hw2_simd_level(void);
+
+// Selects the kernels for level, lowered to the best level the CPU supports. Returns the level
+// now in use. Not thread safe; meant for tests and benchmarks.
+int hw2_simd_set_level(int level);
+
+// Returns how many pixels from the start of pixels have the color of the first one (at least
+// 1 when count > 0).
+size_t hw2_run_length(const unsigned char *pixels, size_t count);
+
+// Stores each pixel as the 24-bit key (r << 16) | (g << 8) | b.
+void hw2_pack_pixels(const unsigned char *pixels, uint32_t *keys, size_t count);
+
+// Sets count pixels of out to the color (r, g, b).
+void hw2_fill_pixels(unsigned char *out, size_t count, unsigned char r, unsigned char g, unsigned char b);
+
+// Decodes up to count whitespace-separated decimal values of one to three digits, each at most
+// maxValue (<= 255), from text[0, len) into out. A value may end at len. Returns the number of
+// values stored and sets *consumed to where decoding stopped: just after the last value once
+// count values are stored, at the start of a malformed token, or at len when the text ran out.
+size_t hw2_decode_bytes(const unsigned char *text, size_t len, unsigned char *out, size_t count, unsigned maxValue,
+                        size_t *consumed);
+
+// Same as hw2_decode_bytes for values of one to nine digits, stored as 32-bit integers.
+size_t hw2_decode_uints(const unsigned char *text, size_t len, uint32_t *out, size_t count, uint32_t maxValue,
+                        size_t *consumed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
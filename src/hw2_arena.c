@@ -0,0 +1,145 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hw2.h"
+#include "hw2_internal.h"
+
+// Size of the blocks small allocations are carved from. Requests of more than a quarter of it,
+// such as pixel arrays, get a block each.
+#ifndef ARENA_BLOCK_SIZE
+#define ARENA_BLOCK_SIZE (1 << 20)
+#endif
+
+// A block that no job has allocated from for this many releases in a row is returned.
+#ifndef ARENA_IDLE_RELEASES
+#define ARENA_IDLE_RELEASES 4
+#endif
+
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+// A block hands out [0, size) of data front to back; last is the offset of the latest
+// allocation, which arena_grow may extend in place. idle counts the releases since it was
+// last allocated from.
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size, used, last;
+    int idle;
+    max_align_t data[];
+};
+
+static inline size_t align_size(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static struct ArenaBlock *arena_new_block(size_t size) {
+    struct ArenaBlock *block = malloc(sizeof(struct ArenaBlock) + size);
+    if (block == NULL) return NULL;
+    block->size = size;
+    block->used = block->last = 0;
+    block->idle = 0;
+    return block;
+}
+
+// A large request takes the smallest free large block that holds it, so a batch of jobs on
+// similar images settles on one block per pixel array.
+static void *arena_allocate_large(Arena *arena, size_t size) {
+    struct ArenaBlock *best = NULL;
+    for (struct ArenaBlock *block = arena->large; block != NULL; block = block->next) {
+        if (block->used == 0 && block->size >= size && (best == NULL || block->size < best->size)) best = block;
+    }
+    if (best == NULL) {
+        best = arena_new_block(size);
+        if (best == NULL) return NULL;
+        best->next = arena->large;
+        arena->large = best;
+    }
+    best->used = size;
+    return best->data;
+}
+
+// Small requests are carved from the current block. The blocks kept from earlier jobs follow
+// it in the chain and are used up in turn before a new one is added.
+void *arena_allocate(Arena *arena, size_t size) {
+    if (size > SIZE_MAX - ARENA_ALIGNMENT - sizeof(struct ArenaBlock)) return NULL;
+    size = align_size(size);
+    if (size > ARENA_BLOCK_SIZE / 4) return arena_allocate_large(arena, size);
+
+    struct ArenaBlock *block = arena->current;
+    while (block != NULL && block->size - block->used < size) block = block->next;
+    if (block == NULL) {
+        block = arena_new_block(ARENA_BLOCK_SIZE);
+        if (block == NULL) return NULL;
+        struct ArenaBlock **link = arena->current != NULL ? &arena->current->next : &arena->small;
+        block->next = *link;
+        *link = block;
+    }
+
+    arena->current = block;
+    block->last = block->used;
+    block->used += size;
+    return (unsigned char *)block->data + block->last;
+}
+
+void *arena_grow(Arena *arena, void *memory, size_t oldSize, size_t newSize) {
+    struct ArenaBlock *block = arena->current;
+    if (memory != NULL && block != NULL && memory == (unsigned char *)block->data + block->last &&
+        newSize <= ARENA_BLOCK_SIZE / 4 && newSize <= block->size - block->last) {
+        block->used = block->last + align_size(newSize);
+        return memory;
+    }
+    void *grown = arena_allocate(arena, newSize);
+    if (grown != NULL && memory != NULL) memcpy(grown, memory, oldSize < newSize ? oldSize : newSize);
+    return grown;
+}
+
+Arena *arena_children(Arena *arena, int count) {
+    if (count > arena->childCount) {
+        Arena *grown = realloc(arena->children, (size_t)count * sizeof(Arena));
+        if (grown == NULL) return NULL;
+        memset(grown + arena->childCount, 0, (size_t)(count - arena->childCount) * sizeof(Arena));
+        arena->children = grown;
+        arena->childCount = count;
+    }
+    return arena->children;
+}
+
+// Empties the blocks of a chain and returns those that have been idle too long.
+static void arena_release_chain(struct ArenaBlock **link) {
+    while (*link != NULL) {
+        struct ArenaBlock *block = *link;
+        block->idle = block->used > 0 ? 0 : block->idle + 1;
+        if (block->idle >= ARENA_IDLE_RELEASES) {
+            *link = block->next;
+            free(block);
+        } else {
+            block->used = block->last = 0;
+            link = &block->next;
+        }
+    }
+}
+
+static void arena_free_chain(struct ArenaBlock **link) {
+    while (*link != NULL) {
+        struct ArenaBlock *next = (*link)->next;
+        free(*link);
+        *link = next;
+    }
+}
+
+void release_arena(Arena *arena) {
+    for (int i = 0; i < arena->childCount; i++) release_arena(&arena->children[i]);
+    arena_release_chain(&arena->small);
+    arena_release_chain(&arena->large);
+    arena->current = arena->small;
+}
+
+void free_arena(Arena *arena) {
+    for (int i = 0; i < arena->childCount; i++) free_arena(&arena->children[i]);
+    free(arena->children);
+    arena->children = NULL;
+    arena->childCount = 0;
+    arena_free_chain(&arena->small);
+    arena_free_chain(&arena->large);
+    arena->current = NULL;
+}
@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "hw2.h"
+#include "hw2_internal.h"
+#include "hw2_simd.h"
+
+#define FONT_MAX_ROWS 32
+#define FONT_SPACE_WIDTH 5
+#define FONT_LETTER_GAP 1
+#define GLYPH_MAX_WIDTH 4096
+
+void free_glyph_atlas(GlyphAtlas *atlas) {
+    free(atlas->bits);
+    free(atlas->spans);
+    free(atlas->rowSpans);
+    atlas->bits = NULL;
+    atlas->spans = NULL;
+    atlas->rowSpans = NULL;
+}
+
+static inline const uint64_t *glyph_row(const GlyphAtlas *atlas, int glyph, int row) {
+    return atlas->bits + ((size_t)glyph * (size_t)atlas->rows + (size_t)row) * (size_t)atlas->wordsPerRow;
+}
+
+// Parses an ASCII-art font of '*' pixels: the glyphs A-Z appear left to right, separated by
+// columns that are blank on every line.
+bool parse_font(const char *fontPath, int scale, GlyphAtlas *atlas) {
+    FILE *file = fopen(fontPath, "r");
+    if (file == NULL) {
+        return hw2_fail(HW2_ERROR_OPEN, "Failed to open the font file.");
+    }
+
+    char *lines[FONT_MAX_ROWS];
+    size_t lengths[FONT_MAX_ROWS];
+    int rows = 0;
+    size_t width = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    bool ok = true;
+    while ((length = getline(&line, &capacity, file)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) length--;
+        if (rows == FONT_MAX_ROWS) {
+            ok = false;
+            break;
+        }
+        lines[rows] = line;
+        lengths[rows] = (size_t)length;
+        if ((size_t)length > width) width = (size_t)length;
+        rows++;
+        line = NULL;
+        capacity = 0;
+    }
+    free(line);
+    fclose(file);
+    // Trailing empty lines are not part of the glyphs.
+    while (rows > 0 && lengths[rows - 1] == 0) free(lines[--rows]);
+
+    int starts[GLYPH_COUNT], widths[GLYPH_COUNT], glyphs = 0;
+    for (size_t col = 0; ok && col < width;) {
+        bool blank = true;
+        for (int r = 0; r < rows && blank; r++) blank = col >= lengths[r] || lines[r][col] == ' ';
+        if (blank) {
+            col++;
+            continue;
+        }
+        if (glyphs == GLYPH_COUNT) {
+            ok = false;
+            break;
+        }
+        starts[glyphs] = (int)col;
+        while (col < width) {
+            blank = true;
+            for (int r = 0; r < rows && blank; r++) blank = col >= lengths[r] || lines[r][col] == ' ';
+            if (blank) break;
+            col++;
+        }
+        widths[glyphs] = (int)col - starts[glyphs];
+        glyphs++;
+    }
+
+    if (!ok || rows == 0 || glyphs != GLYPH_COUNT) {
+        for (int r = 0; r < rows; r++) free(lines[r]);
+        return hw2_fail(HW2_ERROR_FORMAT, "Invalid font file.");
+    }
+
+    int maxWidth = 0;
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        if (widths[g] * scale > maxWidth) maxWidth = widths[g] * scale;
+    }
+    if (maxWidth > GLYPH_MAX_WIDTH) {
+        for (int r = 0; r < rows; r++) free(lines[r]);
+        return hw2_fail(HW2_ERROR_FORMAT, "Invalid font file.");
+    }
+    atlas->rows = rows;
+    atlas->scale = scale;
+    atlas->wordsPerRow = (maxWidth + 63) / 64;
+    atlas->bits = calloc((size_t)GLYPH_COUNT * (size_t)rows * (size_t)atlas->wordsPerRow, sizeof(uint64_t));
+    if (atlas->bits == NULL) {
+        for (int r = 0; r < rows; r++) free(lines[r]);
+        return hw2_fail(HW2_ERROR_MEMORY, "Failed to allocate memory for the font.");
+    }
+
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        atlas->widths[g] = widths[g] * scale;
+        for (int r = 0; r < rows; r++) {
+            uint64_t *bits = (uint64_t *)glyph_row(atlas, g, r);
+            for (int x = 0; x < widths[g]; x++) {
+                size_t col = (size_t)(starts[g] + x);
+                if (col >= lengths[r] || lines[r][col] == ' ') continue;
+                for (int s = x * scale; s < (x + 1) * scale; s++) bits[s / 64] |= 1ull << (s % 64);
+            }
+        }
+    }
+
+    for (int r = 0; r < rows; r++) free(lines[r]);
+    return true;
+}
+
+// Parsed atlases are cached on disk so repeated renders with the same font skip parsing and
+// scaling. The cache lives in $HW2_FONT_CACHE_DIR, or $XDG_CACHE_HOME/hw2, or ~/.cache/hw2;
+// an entry is named after a hash of the key (resolved font path, modification time, size and
+// scale) and repeats the full key in its header, so a stale or colliding entry is never used.
+// Any problem with the cache simply falls back to parsing the font.
+#define ATLAS_CACHE_MAGIC "HW2ATLS1"
+
+typedef struct {
+    char magic[8];
+    int64_t mtimeSec, mtimeNsec, fileSize;
+    int32_t scale, rows, wordsPerRow, pathLength;
+    int32_t widths[GLYPH_COUNT];
+} AtlasCacheHeader;
+
+bool atlas_cache_dir(char *dir, size_t size) {
+    const char *base = getenv("HW2_FONT_CACHE_DIR");
+    if (base != NULL && base[0] != '\0') {
+        snprintf(dir, size, "%s", base);
+    } else if ((base = getenv("XDG_CACHE_HOME")) != NULL && base[0] != '\0') {
+        snprintf(dir, size, "%s/hw2", base);
+    } else if ((base = getenv("HOME")) != NULL && base[0] != '\0') {
+        snprintf(dir, size, "%s/.cache", base);
+        mkdir(dir, 0700);
+        snprintf(dir, size, "%s/.cache/hw2", base);
+    } else {
+        return false;
+    }
+    return mkdir(dir, 0700) == 0 || access(dir, W_OK) == 0;
+}
+
+// Fills in the cache header for fontPath at this scale and the name of its cache file.
+bool atlas_cache_key(const char *fontPath, int scale, AtlasCacheHeader *header, char *resolved, char *cachePath,
+                     size_t cachePathSize) {
+    struct stat fontStat;
+    char dir[PATH_MAX];
+    if (realpath(fontPath, resolved) == NULL || stat(resolved, &fontStat) != 0) return false;
+    if (!atlas_cache_dir(dir, sizeof(dir))) return false;
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, ATLAS_CACHE_MAGIC, sizeof(header->magic));
+    header->mtimeSec = (int64_t)fontStat.st_mtim.tv_sec;
+    header->mtimeNsec = (int64_t)fontStat.st_mtim.tv_nsec;
+    header->fileSize = (int64_t)fontStat.st_size;
+    header->scale = scale;
+    header->pathLength = (int32_t)strlen(resolved);
+
+    // FNV-1a over the path followed by the numeric key fields.
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char *p = resolved; *p; p++) hash = (hash ^ (unsigned char)*p) * 0x100000001b3ull;
+    const unsigned char *fields = (const unsigned char *)&header->mtimeSec;
+    for (size_t i = 0; i < offsetof(AtlasCacheHeader, rows) - offsetof(AtlasCacheHeader, mtimeSec); i++) {
+        hash = (hash ^ fields[i]) * 0x100000001b3ull;
+    }
+    return snprintf(cachePath, cachePathSize, "%s/%016llx.atlas", dir, (unsigned long long)hash) < (int)cachePathSize;
+}
+
+bool atlas_cache_read(const char *cachePath, const AtlasCacheHeader *key, const char *resolved, GlyphAtlas *atlas) {
+    FILE *file = fopen(cachePath, "rb");
+    if (file == NULL) return false;
+
+    AtlasCacheHeader header;
+    char path[PATH_MAX];
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(&header, key, offsetof(AtlasCacheHeader, rows)) == 0 && header.pathLength == key->pathLength &&
+              header.rows > 0 && header.rows <= FONT_MAX_ROWS && header.wordsPerRow > 0 &&
+              header.wordsPerRow <= GLYPH_MAX_WIDTH / 64 &&
+              fread(path, 1, (size_t)header.pathLength, file) == (size_t)header.pathLength &&
+              memcmp(path, resolved, (size_t)header.pathLength) == 0;
+
+    size_t words = ok ? (size_t)GLYPH_COUNT * (size_t)header.rows * (size_t)header.wordsPerRow : 0;
+    uint64_t *bits = ok ? malloc(words * sizeof(uint64_t)) : NULL;
+    ok = bits != NULL && fread(bits, sizeof(uint64_t), words, file) == words;
+    fclose(file);
+    if (!ok) {
+        free(bits);
+        return false;
+    }
+
+    atlas->rows = header.rows;
+    atlas->scale = header.scale;
+    atlas->wordsPerRow = header.wordsPerRow;
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        if (header.widths[g] < 0 || header.widths[g] > header.wordsPerRow * 64) {
+            free(bits);
+            return false;
+        }
+        atlas->widths[g] = header.widths[g];
+    }
+    atlas->bits = bits;
+    return true;
+}
+
+// Writes to a unique temporary file and renames it into place, so concurrent renders (other
+// processes or batch workers) never see a partially written entry.
+void atlas_cache_write(const char *cachePath, AtlasCacheHeader *header, const char *resolved, const GlyphAtlas *atlas) {
+    char tempPath[PATH_MAX + 16];
+    snprintf(tempPath, sizeof(tempPath), "%s.XXXXXX", cachePath);
+    int fd = mkstemp(tempPath);
+    if (fd < 0) return;
+    FILE *file = fdopen(fd, "wb");
+    if (file == NULL) {
+        close(fd);
+        remove(tempPath);
+        return;
+    }
+
+    header->rows = atlas->rows;
+    header->wordsPerRow = atlas->wordsPerRow;
+    for (int g = 0; g < GLYPH_COUNT; g++) header->widths[g] = atlas->widths[g];
+    size_t words = (size_t)GLYPH_COUNT * (size_t)atlas->rows * (size_t)atlas->wordsPerRow;
+    bool ok = fwrite(header, sizeof(*header), 1, file) == 1 &&
+              fwrite(resolved, 1, (size_t)header->pathLength, file) == (size_t)header->pathLength &&
+              fwrite(atlas->bits, sizeof(uint64_t), words, file) == words;
+    if (fclose(file) != 0) ok = false;
+    if (!ok || rename(tempPath, cachePath) != 0) remove(tempPath);
+}
+
+// Splits every bitmask row into runs of set bits. Runs stay within a row of at most
+// GLYPH_MAX_WIDTH pixels, so they fit the 16-bit fields.
+bool build_glyph_spans(GlyphAtlas *atlas) {
+    size_t rowCount = (size_t)GLYPH_COUNT * (size_t)atlas->rows;
+    size_t capacity = 1, count = 0;
+    // Every run holds at least one set bit.
+    for (size_t i = 0; i < rowCount * (size_t)atlas->wordsPerRow; i++) capacity += (size_t)__builtin_popcountll(atlas->bits[i]);
+    atlas->spans = malloc(capacity * sizeof(GlyphSpan));
+    atlas->rowSpans = malloc((rowCount + 1) * sizeof(int));
+    if (atlas->spans == NULL || atlas->rowSpans == NULL) {
+        return hw2_fail(HW2_ERROR_MEMORY, "Failed to allocate memory for the font.");
+    }
+
+    int bitCount = atlas->wordsPerRow * 64;
+    for (size_t r = 0; r < rowCount; r++) {
+        const uint64_t *bits = atlas->bits + r * (size_t)atlas->wordsPerRow;
+        atlas->rowSpans[r] = (int)count;
+        int bit = 0;
+        while (bit < bitCount) {
+            // Skip to the next set bit, then to the next clear one.
+            uint64_t word = bits[bit / 64] >> (bit % 64);
+            if (word == 0) {
+                bit = (bit / 64 + 1) * 64;
+                continue;
+            }
+            int start = bit + __builtin_ctzll(word);
+            bit = start;
+            while (bit < bitCount) {
+                uint64_t inverted = ~bits[bit / 64] >> (bit % 64);
+                if (inverted == 0 || bit % 64 + __builtin_ctzll(inverted) >= 64) {
+                    bit = (bit / 64 + 1) * 64;
+                    continue;
+                }
+                bit += __builtin_ctzll(inverted);
+                break;
+            }
+            atlas->spans[count].start = (uint16_t)start;
+            atlas->spans[count].length = (uint16_t)(bit - start);
+            count++;
+        }
+    }
+    atlas->rowSpans[rowCount] = (int)count;
+    return true;
+}
+
+static int read_glyph_atlas(const char *fontPath, int scale, GlyphAtlas *atlas) {
+    AtlasCacheHeader header;
+    char resolved[PATH_MAX], cachePath[PATH_MAX];
+    memset(atlas, 0, sizeof(*atlas));
+    bool cacheable = atlas_cache_key(fontPath, scale, &header, resolved, cachePath, sizeof(cachePath));
+    if (!cacheable || !atlas_cache_read(cachePath, &header, resolved, atlas)) {
+        if (!parse_font(fontPath, scale, atlas)) return hw2_status(false);
+        if (cacheable) atlas_cache_write(cachePath, &header, resolved, atlas);
+    }
+
+    if (!build_glyph_spans(atlas)) {
+        free_glyph_atlas(atlas);
+        return hw2_status(false);
+    }
+    return HW2_OK;
+}
+
+int load_glyph_atlas(const char *fontPath, int scale, GlyphAtlas *atlas) {
+    int previous = hw2_stats_stage(HW2_STAGE_RENDER);
+    int status = read_glyph_atlas(fontPath, scale, atlas);
+    hw2_stats_stage(previous);
+    return status;
+}
+
+// Draws message in white with its top-left corner at (row, col) of an image whose rows from
+// top on are held in image, so a streamed image can be drawn one band at a time. Letters are
+// separated by a one pixel gap and a space advances FONT_SPACE_WIDTH pixels; neither is
+// scaled. The first letter that would not fit entirely inside the image width ends the
+// message, so only the text rows outside the band need clipping, and that is worked out once
+// per glyph. Each glyph row is then drawn as its precomputed spans, once per scaled line, so
+// the cost follows the number of spans rather than the glyph area.
+static void draw_text(Image *image, int top, const GlyphAtlas *atlas, const char *message, int row, int col) {
+    const RGBPixel white = {255, 255, 255};
+    int height = atlas->rows * atlas->scale;
+    if (height > top + image->height - row) height = top + image->height - row;
+    int first = top > row ? top - row : 0;
+    if (first >= height) return;
+    size_t stride = (size_t)image->width;
+
+    int x = col;
+    for (const char *ch = message; *ch; ch++) {
+        int letter = toupper((unsigned char)*ch) - 'A';
+        if (letter < 0 || letter >= GLYPH_COUNT) {
+            x += FONT_SPACE_WIDTH;
+            continue;
+        }
+        int width = atlas->widths[letter];
+        if (x + width > image->width) break;
+
+        RGBPixel *origin = image->pixels + (size_t)x;
+        const int *rowSpans = atlas->rowSpans + (size_t)letter * (size_t)atlas->rows;
+        for (int y = first, r = first / atlas->scale; y < height; r++) {
+            const GlyphSpan *spansFirst = atlas->spans + rowSpans[r];
+            const GlyphSpan *spansLast = atlas->spans + rowSpans[r + 1];
+            int lineEnd = (r + 1) * atlas->scale < height ? (r + 1) * atlas->scale : height;
+            for (; y < lineEnd; y++) {
+                RGBPixel *out = origin + (size_t)(row + y - top) * stride;
+                for (const GlyphSpan *span = spansFirst; span < spansLast; span++) {
+                    hw2_fill_pixels((unsigned char *)(out + span->start), span->length, white.r, white.g, white.b);
+                }
+            }
+        }
+        x += width + FONT_LETTER_GAP;
+    }
+}
+
+void render_text(Image *image, const GlyphAtlas *atlas, const char *message, int row, int col) {
+    int previous = hw2_stats_stage(HW2_STAGE_RENDER);
+    draw_text(image, 0, atlas, message, row, col);
+    hw2_stats_stage(previous);
+}
+
+void render_text_band(Image *band, int top, const GlyphAtlas *atlas, const char *message, int row, int col) {
+    int previous = hw2_stats_stage(HW2_STAGE_RENDER);
+    draw_text(band, top, atlas, message, row, col);
+    hw2_stats_stage(previous);
+}
@@ -0,0 +1,1685 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hw2.h"
+#include "hw2_internal.h"
+#include "hw2_simd.h"
+
+_Static_assert(sizeof(RGBPixel) == 3, "RGBPixel must be a packed byte triple");
+
+// Last failure of the calling thread, as reported by hw2_error_message. Batch jobs run on
+// several threads at once, so each keeps its own.
+static _Thread_local int lastErrorCode = HW2_OK;
+static _Thread_local char lastErrorMessage[512];
+
+static void record_error(int code, const char *format, va_list args) {
+    vsnprintf(lastErrorMessage, sizeof(lastErrorMessage), format, args);
+    lastErrorCode = code;
+}
+
+bool hw2_fail(int code, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    record_error(code, format, args);
+    va_end(args);
+    return false;
+}
+
+int hw2_error(int code, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    record_error(code, format, args);
+    va_end(args);
+    return code;
+}
+
+int hw2_status(bool ok) {
+    return ok ? HW2_OK : lastErrorCode;
+}
+
+const char *hw2_error_message(void) {
+    return lastErrorMessage;
+}
+
+void release_image(Image *image) {
+    if (image->mapping) munmap(image->mapping, image->mappingSize);
+    image->pixels = NULL;
+    image->mapping = NULL;
+}
+
+void free_image(Image *image) {
+    release_image(image);
+    free(image->buffer);
+    image->buffer = NULL;
+    image->capacity = 0;
+}
+
+// Points pixels at a buffer of at least count pixels: a new allocation from the image's arena,
+// or else the retained buffer, grown only when it is too small. The old contents are not
+// preserved.
+bool reserve_pixels(Image *image, size_t count) {
+    if (image->arena) {
+        image->pixels = arena_allocate(image->arena, count * sizeof(RGBPixel));
+        return image->pixels != NULL;
+    }
+    if (count > image->capacity) {
+        free(image->buffer);
+        image->buffer = malloc(count * sizeof(RGBPixel));
+        image->capacity = image->buffer != NULL ? count : 0;
+        if (image->buffer == NULL) return false;
+    }
+    image->pixels = image->buffer;
+    return true;
+}
+
+int allocate_image(Image *image, int width, int height) {
+    release_image(image);
+    if (width <= 0 || height <= 0) return hw2_error(HW2_ERROR_FORMAT, "Invalid image size %dx%d.", width, height);
+    if (!reserve_pixels(image, (size_t)width * (size_t)height)) {
+        return hw2_error(HW2_ERROR_MEMORY, "Unable to allocate memory for pixels.");
+    }
+    image->width = width;
+    image->height = height;
+    return HW2_OK;
+}
+
+
+#define READ_BUFFER_SIZE (1 << 16)
+#define SCANNER_PADDING 4
+
+// Reader for the image formats. Regular files are memory-mapped and parsed in place; anything
+// else (pipes, failed mappings) is read in blocks through stdio. Tokens are only parsed from
+// [pos, limit), where limit always falls just after a whitespace byte (or at end of file), so
+// a number never spans two blocks and the digit loops need no bounds checks. NUL padding
+// follows the data in both modes.
+typedef struct {
+    FILE *file;
+    unsigned char *buffer;
+    size_t pos, limit, len;
+    bool eof;
+    void *mapping;
+    size_t mappingSize;
+    dev_t device;
+    ino_t inode;
+} TextScanner;
+
+// Maps size bytes of fd privately, followed by at least SCANNER_PADDING zero bytes: an
+// anonymous region one page larger than needed is reserved and the file mapped over its start.
+// With writable set, stores into the mapping copy the touched pages and never reach the file.
+void *map_file(int fd, size_t size, bool writable, size_t *mappingSize) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t total = (size + SCANNER_PADDING + page - 1) / page * page;
+    int protection = PROT_READ | (writable ? PROT_WRITE : 0);
+    void *base = mmap(NULL, total, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+    if (size > 0 && mmap(base, size, protection, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, total);
+        return NULL;
+    }
+    *mappingSize = total;
+    return base;
+}
+
+bool scanner_open_mapped(TextScanner *scanner, const char *filename, bool writable) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    void *mapping = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        mapping = map_file(fd, (size_t)st.st_size, writable, &scanner->mappingSize);
+    }
+    close(fd);
+    if (!mapping) return false;
+
+    posix_madvise(mapping, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    HW2_STATS_ADD(bytesRead, (uint64_t)st.st_size);
+    scanner->file = NULL;
+    scanner->mapping = mapping;
+    scanner->device = st.st_dev;
+    scanner->inode = st.st_ino;
+    scanner->buffer = mapping;
+    scanner->pos = 0;
+    scanner->limit = scanner->len = (size_t)st.st_size;
+    scanner->eof = true;
+    return true;
+}
+
+bool scanner_open_buffered(TextScanner *scanner, const char *filename) {
+    scanner->mapping = NULL;
+    scanner->file = fopen(filename, "rb");
+    if (!scanner->file) {
+        return false;
+    }
+    scanner->buffer = malloc(READ_BUFFER_SIZE + SCANNER_PADDING);
+    if (!scanner->buffer) {
+        fclose(scanner->file);
+        return false;
+    }
+    scanner->pos = scanner->limit = scanner->len = 0;
+    scanner->eof = false;
+    return true;
+}
+
+// writable only matters for mapped files: it lets load_ppm hand out a raw pixel mapping that
+// the editing steps may write to.
+bool scanner_open(TextScanner *scanner, const char *filename, bool writable) {
+    return scanner_open_mapped(scanner, filename, writable) || scanner_open_buffered(scanner, filename);
+}
+
+void scanner_close(TextScanner *scanner) {
+    if (scanner->mapping) {
+        munmap(scanner->mapping, scanner->mappingSize);
+    } else if (scanner->file) {
+        free(scanner->buffer);
+        fclose(scanner->file);
+    }
+}
+
+static inline bool is_space(unsigned char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+// Moves the unparsed tail to the front of the buffer and reads the next block behind it.
+// Returns false once the file is exhausted.
+bool scanner_refill(TextScanner *scanner) {
+    if (scanner->eof) return false;
+
+    size_t rest = scanner->len - scanner->pos;
+    memmove(scanner->buffer, scanner->buffer + scanner->pos, rest);
+    size_t wanted = READ_BUFFER_SIZE - rest;
+    size_t got = fread(scanner->buffer + rest, 1, wanted, scanner->file);
+    HW2_STATS_ADD(bytesRead, got);
+    scanner->pos = 0;
+    scanner->len = rest + got;
+    memset(scanner->buffer + scanner->len, 0, SCANNER_PADDING);
+    scanner->eof = got < wanted;
+
+    scanner->limit = scanner->len;
+    if (!scanner->eof) {
+        while (scanner->limit > 0 && !is_space(scanner->buffer[scanner->limit - 1])) scanner->limit--;
+        if (scanner->limit == 0) scanner->limit = scanner->len;
+    }
+    return true;
+}
+
+// Skips whitespace, refilling as needed. Returns false if end of file is reached first.
+static inline bool scanner_skip_space(TextScanner *scanner) {
+    for (;;) {
+        while (scanner->pos < scanner->limit && is_space(scanner->buffer[scanner->pos])) scanner->pos++;
+        if (scanner->pos < scanner->limit) return true;
+        if (!scanner_refill(scanner)) return false;
+    }
+}
+
+// Reads the next whitespace-separated unsigned decimal integer. Fails on EOF, on a
+// non-digit character, or when the value does not fit in an int.
+bool scanner_read_uint(TextScanner *scanner, int *value) {
+    if (!scanner_skip_space(scanner)) return false;
+
+    const unsigned char *p = scanner->buffer + scanner->pos;
+    unsigned digit = (unsigned)*p - '0';
+    if (digit > 9) return false;
+
+    long result = 0;
+    do {
+        result = result * 10 + digit;
+        if (result > 0x7fffffff) return false;
+        digit = (unsigned)*++p - '0';
+    } while (digit <= 9);
+
+    if (p != scanner->buffer + scanner->len && !is_space(*p)) return false;
+    scanner->pos = (size_t)(p - scanner->buffer);
+    *value = (int)result;
+    return true;
+}
+
+// Copies the next size bytes verbatim: first whatever is still buffered, then the rest with
+// a single fread straight into out. Returns the number of bytes stored.
+size_t scanner_read_raw(TextScanner *scanner, void *out, size_t size) {
+    size_t buffered = scanner->len - scanner->pos;
+    if (buffered > size) buffered = size;
+    memcpy(out, scanner->buffer + scanner->pos, buffered);
+    scanner->pos += buffered;
+    if (buffered == size || scanner->eof) return buffered;
+    size_t got = fread((unsigned char *)out + buffered, 1, size - buffered, scanner->file);
+    HW2_STATS_ADD(bytesRead, got);
+    return buffered + got;
+}
+
+// Decodes up to count whitespace-separated values in [0, maxValue] (maxValue <= 255) into out.
+// This is the hot loop for pixel data: each block is handed to the vector decoder, and the
+// scanner is only touched again at block boundaries. Returns the number of values stored;
+// fewer than count means the stream ended or held a malformed token.
+size_t scanner_read_bytes(TextScanner *scanner, unsigned char *out, size_t count, unsigned maxValue) {
+    size_t done = 0;
+    while (done < count && scanner_skip_space(scanner)) {
+        size_t consumed;
+        done += hw2_decode_bytes(scanner->buffer + scanner->pos, scanner->limit - scanner->pos, out + done, count - done,
+                                 maxValue, &consumed);
+        scanner->pos += consumed;
+        if (scanner->pos != scanner->limit) break;
+    }
+    return done;
+}
+
+// Same as scanner_read_bytes for values of up to nine digits. SBU index streams use it; a '*'
+// run marker counts as a malformed token, so decoding stops in front of it.
+size_t scanner_read_uints(TextScanner *scanner, uint32_t *out, size_t count, uint32_t maxValue) {
+    size_t done = 0;
+    while (done < count && scanner_skip_space(scanner)) {
+        size_t consumed;
+        done += hw2_decode_uints(scanner->buffer + scanner->pos, scanner->limit - scanner->pos, out + done, count - done,
+                                 maxValue, &consumed);
+        scanner->pos += consumed;
+        if (scanner->pos != scanner->limit) break;
+    }
+    return done;
+}
+
+// timed is set when the caller collects statistics; the thread then measures its CPU time.
+typedef struct {
+    void (*task)(void *context, int index);
+    void *context;
+    int index;
+    bool timed;
+    double cpuSeconds;
+} ParallelTask;
+
+static void *parallel_task_main(void *arg) {
+    ParallelTask *task = arg;
+    double start = task->timed ? hw2_thread_cpu_seconds() : 0.0;
+    task->task(task->context, task->index);
+    if (task->timed) task->cpuSeconds = hw2_thread_cpu_seconds() - start;
+    return NULL;
+}
+
+// Runs task(context, index) for index 0 .. count - 1, each on its own thread; index 0 runs on
+// the calling thread. Tasks whose thread cannot be started run on the calling thread too. The
+// CPU time of the other threads is charged to the caller's current stage.
+void parallel_for(int count, void (*task)(void *context, int index), void *context) {
+    ParallelTask *tasks = count > 1 ? malloc((size_t)count * sizeof(ParallelTask)) : NULL;
+    pthread_t *threads = count > 1 ? malloc((size_t)count * sizeof(pthread_t)) : NULL;
+    bool *started = count > 1 ? calloc((size_t)count, sizeof(bool)) : NULL;
+    if (tasks == NULL || threads == NULL || started == NULL) {
+        free(tasks);
+        free(threads);
+        free(started);
+        for (int i = 0; i < count; i++) task(context, i);
+        return;
+    }
+
+    for (int i = 1; i < count; i++) {
+        tasks[i] = (ParallelTask){task, context, i, hw2ActiveStats != NULL, 0.0};
+        started[i] = pthread_create(&threads[i], NULL, parallel_task_main, &tasks[i]) == 0;
+    }
+    task(context, 0);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+            hw2_stats_add_cpu(tasks[i].cpuSeconds);
+        } else {
+            task(context, i);
+        }
+    }
+    free(tasks);
+    free(threads);
+    free(started);
+}
+
+static _Thread_local int threadBudget = 0;
+
+void hw2_set_thread_budget(int threads) {
+    threadBudget = threads > 0 ? threads : 0;
+}
+
+// Worker count for a job of size bytes handled in pieces of at least minBytes: one per online
+// processor, or per thread of the calling thread's budget if it has one, but no more than
+// there are pieces.
+int parallel_worker_count(size_t size, size_t minBytes) {
+    long processors = threadBudget > 0 ? threadBudget : sysconf(_SC_NPROCESSORS_ONLN);
+    size_t pieces = size / minBytes;
+    if (processors < 1) processors = 1;
+    if (pieces < 1) pieces = 1;
+    return pieces < (size_t)processors ? (int)pieces : (int)processors;
+}
+
+// Parses the magic number, dimensions and max color value, leaving the scanner on the
+// whitespace byte in front of the pixel data. raw is set for P6 files.
+bool ppm_read_header(TextScanner *scanner, int *width, int *height, bool *raw) {
+    if (scanner->len == 0) scanner_refill(scanner);
+    if (scanner->len < 3 || scanner->buffer[0] != 'P' ||
+        (scanner->buffer[1] != '3' && scanner->buffer[1] != '6') || !is_space(scanner->buffer[2])) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Invalid PPM file format.");
+    }
+    *raw = scanner->buffer[1] == '6';
+    scanner->pos = 2;
+
+    if (!scanner_read_uint(scanner, width) || !scanner_read_uint(scanner, height) || *width <= 0 || *height <= 0) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Failed to read image dimensions.");
+    }
+
+    int maxColorValue;
+    if (!scanner_read_uint(scanner, &maxColorValue) || maxColorValue != 255) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Invalid or unsupported max color value.");
+    }
+    return true;
+}
+
+#ifndef PARALLEL_PARSE_MIN_BYTES
+#define PARALLEL_PARSE_MIN_BYTES (8 << 20)
+#endif
+
+// Parallel decoding of plain PPM pixel data that is entirely in memory. The text is cut into
+// one chunk per thread, each ending just after a whitespace byte, so no number straddles two
+// chunks. A first pass counts the numbers in every chunk; a prefix sum over the counts gives
+// the component offset each chunk decodes to, which may fall in the middle of a pixel.
+typedef struct {
+    const unsigned char *text;
+    size_t *bounds;
+    size_t *counts, *offsets, *decoded;
+    unsigned char *out;
+    size_t needed;
+} P3Chunks;
+
+static void p3_count_chunk(void *context, int index) {
+    P3Chunks *chunks = context;
+    const unsigned char *text = chunks->text;
+    size_t begin = chunks->bounds[index], end = chunks->bounds[index + 1];
+    size_t count = 0;
+    // A number starts at every non-space byte that follows a space; chunks begin after one.
+    unsigned previousSpace = 1;
+    for (size_t i = begin; i < end; i++) {
+        unsigned space = is_space(text[i]);
+        count += previousSpace & (space ^ 1);
+        previousSpace = space;
+    }
+    chunks->counts[index] = count;
+}
+
+static void p3_decode_chunk(void *context, int index) {
+    P3Chunks *chunks = context;
+    size_t offset = chunks->offsets[index];
+    size_t wanted = offset < chunks->needed ? chunks->needed - offset : 0;
+    if (wanted > chunks->counts[index]) wanted = chunks->counts[index];
+
+    TextScanner scanner = {0};
+    scanner.buffer = (unsigned char *)chunks->text + chunks->bounds[index];
+    scanner.limit = scanner.len = chunks->bounds[index + 1] - chunks->bounds[index];
+    scanner.eof = true;
+    chunks->decoded[index] = scanner_read_bytes(&scanner, chunks->out + offset, wanted, 255);
+}
+
+// Decodes count components from text[0, size), which must be followed by NUL padding, into
+// out using threads workers. Returns the number of components decoded before the first
+// malformed or missing value, as scanner_read_bytes would.
+size_t p3_decode_parallel(const unsigned char *text, size_t size, unsigned char *out, size_t count, int threads) {
+    size_t *bounds = malloc((size_t)(threads + 1) * sizeof(size_t));
+    size_t *counts = malloc((size_t)threads * 3 * sizeof(size_t));
+    if (bounds == NULL || counts == NULL) {
+        free(bounds);
+        free(counts);
+        TextScanner scanner = {0};
+        scanner.buffer = (unsigned char *)text;
+        scanner.limit = scanner.len = size;
+        scanner.eof = true;
+        return scanner_read_bytes(&scanner, out, count, 255);
+    }
+
+    bounds[0] = 0;
+    for (int i = 1; i < threads; i++) {
+        size_t bound = size / (size_t)threads * (size_t)i;
+        if (bound < bounds[i - 1]) bound = bounds[i - 1];
+        while (bound < size && !is_space(text[bound])) bound++;
+        if (bound < size) bound++;
+        bounds[i] = bound;
+    }
+    bounds[threads] = size;
+
+    P3Chunks chunks = {text, bounds, counts, counts + threads, counts + 2 * threads, out, count};
+    parallel_for(threads, p3_count_chunk, &chunks);
+    size_t total = 0;
+    for (int i = 0; i < threads; i++) {
+        chunks.offsets[i] = total;
+        total += chunks.counts[i];
+    }
+    parallel_for(threads, p3_decode_chunk, &chunks);
+
+    // The result ends at the first chunk that stopped short, or at the end of the numbers.
+    size_t decoded = total < count ? total : count;
+    for (int i = 0; i < threads; i++) {
+        size_t wanted = chunks.offsets[i] >= count ? 0 : count - chunks.offsets[i];
+        if (wanted > chunks.counts[i]) wanted = chunks.counts[i];
+        if (chunks.decoded[i] < wanted) {
+            decoded = chunks.offsets[i] + chunks.decoded[i];
+            break;
+        }
+    }
+
+    free(bounds);
+    free(counts);
+    return decoded;
+}
+
+// With writable set, a raw image loaded straight from a file mapping may be edited in place;
+// otherwise its pixels are read-only.
+static int read_ppm_file(const char *filename, Image *image, bool writable) {
+    release_image(image);
+    TextScanner scanner;
+    if (!scanner_open(&scanner, filename, writable)) {
+        return hw2_error(HW2_ERROR_OPEN, "Unable to open file: %s", strerror(errno));
+    }
+
+    bool raw;
+    if (!ppm_read_header(&scanner, &image->width, &image->height, &raw)) {
+        scanner_close(&scanner);
+        return hw2_status(false);
+    }
+
+    size_t pixelCount = (size_t)image->width * (size_t)image->height;
+
+    // A mapped P6 file already holds the pixel array verbatim: the image takes over the
+    // mapping and points into it instead of copying.
+    if (raw && scanner.mapping) {
+        if (scanner.pos < scanner.len) scanner.pos++;
+        if (scanner.len - scanner.pos < pixelCount * 3) {
+            hw2_fail(HW2_ERROR_FORMAT, "Error reading pixel data at pixel %zu.", (scanner.len - scanner.pos) / 3);
+            scanner_close(&scanner);
+            return hw2_status(false);
+        }
+        image->pixels = (RGBPixel *)(scanner.buffer + scanner.pos);
+        image->mapping = scanner.mapping;
+        image->mappingSize = scanner.mappingSize;
+        image->mappedDevice = scanner.device;
+        image->mappedInode = scanner.inode;
+        return HW2_OK;
+    }
+
+    if (!reserve_pixels(image, pixelCount)) {
+        hw2_fail(HW2_ERROR_MEMORY, "Memory allocation failed.");
+        scanner_close(&scanner);
+        return hw2_status(false);
+    }
+
+    // P6 pixel data starts after exactly one whitespace byte and is already laid out as
+    // packed RGB triples, so it is read into the pixel array in one go.
+    size_t components;
+    if (raw) {
+        scanner.pos++;
+        components = scanner_read_raw(&scanner, image->pixels, pixelCount * 3);
+    } else if (scanner.mapping && scanner.len - scanner.pos >= 2 * PARALLEL_PARSE_MIN_BYTES) {
+        // Large mapped files are decoded by several threads at once.
+        size_t size = scanner.len - scanner.pos;
+        components = p3_decode_parallel(scanner.buffer + scanner.pos, size, (unsigned char *)image->pixels,
+                                        pixelCount * 3, parallel_worker_count(size, PARALLEL_PARSE_MIN_BYTES));
+    } else {
+        components = scanner_read_bytes(&scanner, (unsigned char *)image->pixels, pixelCount * 3, 255);
+    }
+    if (components != pixelCount * 3) {
+        hw2_fail(HW2_ERROR_FORMAT, "Error reading pixel data at pixel %zu.", components / 3);
+        image->pixels = NULL;
+        scanner_close(&scanner);
+        return hw2_status(false);
+    }
+
+    scanner_close(&scanner);
+    return HW2_OK;
+}
+
+int load_ppm(const char *filename, Image *image, bool writable) {
+    int previous = hw2_stats_stage(HW2_STAGE_LOAD);
+    int status = read_ppm_file(filename, image, writable);
+    if (status == HW2_OK) HW2_STATS_ADD(pixels, (uint64_t)image->width * (uint64_t)image->height);
+    hw2_stats_stage(previous);
+    return status;
+}
+
+static inline uint32_t pack_rgb(RGBPixel pixel) {
+    return ((uint32_t)pixel.r << 16) | ((uint32_t)pixel.g << 8) | (uint32_t)pixel.b;
+}
+
+// Open-addressing hash map from packed RGB to palette index. Packed colors only use the low
+// 24 bits, so an all-ones key marks an empty slot.
+#define COLOR_MAP_EMPTY 0xffffffffu
+#define COLOR_MAP_INITIAL_CAPACITY 1024
+
+typedef struct {
+    uint32_t key;
+    int index;
+} ColorMapSlot;
+
+// The slot tables live in arena; a table outgrown by color_map_grow stays there unused.
+typedef struct {
+    ColorMapSlot *slots;
+    size_t mask;
+    size_t count;
+    Arena *arena;
+} ColorMap;
+
+bool color_map_init(ColorMap *map, Arena *arena, size_t capacity) {
+    map->slots = arena_allocate(arena, capacity * sizeof(ColorMapSlot));
+    if (!map->slots) return false;
+    for (size_t i = 0; i < capacity; i++) map->slots[i].key = COLOR_MAP_EMPTY;
+    map->mask = capacity - 1;
+    map->count = 0;
+    map->arena = arena;
+    return true;
+}
+
+static inline size_t color_map_hash(uint32_t key, size_t mask) {
+    return (size_t)(key * 0x9e3779b1u) & mask;
+}
+
+bool color_map_grow(ColorMap *map) {
+    ColorMap bigger;
+    if (!color_map_init(&bigger, map->arena, (map->mask + 1) * 2)) return false;
+    for (size_t i = 0; i <= map->mask; i++) {
+        if (map->slots[i].key == COLOR_MAP_EMPTY) continue;
+        size_t slot = color_map_hash(map->slots[i].key, bigger.mask);
+        while (bigger.slots[slot].key != COLOR_MAP_EMPTY) slot = (slot + 1) & bigger.mask;
+        bigger.slots[slot] = map->slots[i];
+    }
+    bigger.count = map->count;
+    *map = bigger;
+    return true;
+}
+
+// Returns the index stored for key, inserting nextIndex if the key is new. Returns -1 if the
+// table could not grow.
+int color_map_insert(ColorMap *map, uint32_t key, int nextIndex) {
+    size_t slot = color_map_hash(key, map->mask);
+    while (map->slots[slot].key != COLOR_MAP_EMPTY) {
+        if (map->slots[slot].key == key) return map->slots[slot].index;
+        slot = (slot + 1) & map->mask;
+    }
+    if ((map->count + 1) * 2 > map->mask + 1) {
+        if (!color_map_grow(map)) return -1;
+        return color_map_insert(map, key, nextIndex);
+    }
+    map->slots[slot].key = key;
+    map->slots[slot].index = nextIndex;
+    map->count++;
+    return nextIndex;
+}
+
+// Returns the palette index stored for key, or -1 if the color is not in the map.
+static inline int color_map_find(const ColorMap *map, uint32_t key) {
+    size_t slot = color_map_hash(key, map->mask);
+    while (map->slots[slot].key != COLOR_MAP_EMPTY) {
+        if (map->slots[slot].key == key) return map->slots[slot].index;
+        slot = (slot + 1) & map->mask;
+    }
+    return -1;
+}
+
+// Incremental palette construction: pixels can be fed in any number of batches (a whole image
+// or one band of rows at a time) and colors are numbered in order of first appearance. The
+// colors and the map are allocated from arena and released with it.
+typedef struct {
+    Arena *arena;
+    ColorMap map;
+    RGBPixel *colors;
+    int size;
+    size_t capacity;
+    uint32_t previousKey;
+} PaletteBuilder;
+
+bool palette_builder_init(PaletteBuilder *builder, Arena *arena) {
+    builder->arena = arena;
+    builder->capacity = 64;
+    builder->size = 0;
+    builder->previousKey = COLOR_MAP_EMPTY;
+    builder->colors = arena_allocate(arena, builder->capacity * sizeof(RGBPixel));
+    return builder->colors != NULL && color_map_init(&builder->map, arena, COLOR_MAP_INITIAL_CAPACITY);
+}
+
+#define PALETTE_KEY_BLOCK 512
+
+// Pixels are packed into hash keys a block at a time by the vector kernel.
+bool palette_builder_add(PaletteBuilder *builder, const RGBPixel *pixels, size_t count) {
+    uint32_t keys[PALETTE_KEY_BLOCK];
+    for (size_t base = 0; base < count; base += PALETTE_KEY_BLOCK) {
+        size_t blockSize = count - base < PALETTE_KEY_BLOCK ? count - base : PALETTE_KEY_BLOCK;
+        hw2_pack_pixels((const unsigned char *)(pixels + base), keys, blockSize);
+
+        for (size_t i = 0; i < blockSize; i++) {
+            uint32_t key = keys[i];
+            if (key == builder->previousKey) continue;
+            builder->previousKey = key;
+
+            int index = color_map_insert(&builder->map, key, builder->size);
+            if (index < 0) return false;
+            if (index < builder->size) continue;
+
+            if ((size_t)builder->size == builder->capacity) {
+                RGBPixel *grown = arena_grow(builder->arena, builder->colors, builder->capacity * sizeof(RGBPixel),
+                                             builder->capacity * 2 * sizeof(RGBPixel));
+                if (!grown) return false;
+                builder->colors = grown;
+                builder->capacity *= 2;
+            }
+            builder->colors[builder->size++] = pixels[base + i];
+        }
+    }
+    return true;
+}
+
+#ifndef PARALLEL_PALETTE_MIN_PIXELS
+#define PARALLEL_PALETTE_MIN_PIXELS (1 << 20)
+#endif
+
+// Per-thread palettes over horizontal stripes of an image. Arenas are not shared between
+// threads, so each stripe builds into a child arena of the caller's.
+typedef struct {
+    const Image *image;
+    int stripes;
+    Arena *arenas;
+    PaletteBuilder *builders;
+    bool *built;
+} PaletteStripes;
+
+static void palette_stripe_task(void *context, int index) {
+    PaletteStripes *stripes = context;
+    const Image *image = stripes->image;
+    size_t first = (size_t)image->height * (size_t)index / (size_t)stripes->stripes;
+    size_t last = (size_t)image->height * (size_t)(index + 1) / (size_t)stripes->stripes;
+    PaletteBuilder *builder = &stripes->builders[index];
+    stripes->built[index] = palette_builder_init(builder, &stripes->arenas[index]);
+    if (stripes->built[index]) {
+        stripes->built[index] = palette_builder_add(builder, image->pixels + first * (size_t)image->width,
+                                                    (last - first) * (size_t)image->width);
+    }
+}
+
+// Builds the stripe palettes in parallel, then feeds each stripe's colors into builder in
+// stripe order. A stripe lists its colors in order of first appearance within the stripe, so
+// the merged numbering is exactly the first-appearance order of a serial scan.
+bool build_palette_parallel(Image *image, PaletteBuilder *builder, int threads) {
+    PaletteStripes stripes = {image, threads, arena_children(builder->arena, threads),
+                              arena_allocate(builder->arena, (size_t)threads * sizeof(PaletteBuilder)),
+                              arena_allocate(builder->arena, (size_t)threads * sizeof(bool))};
+    if (stripes.arenas == NULL || stripes.builders == NULL || stripes.built == NULL) return false;
+    parallel_for(threads, palette_stripe_task, &stripes);
+
+    bool ok = true;
+    for (int i = 0; ok && i < threads; i++) {
+        ok = stripes.built[i] && palette_builder_add(builder, stripes.builders[i].colors, (size_t)stripes.builders[i].size);
+    }
+    return ok;
+}
+
+// Builds the palette in one pass over the image, split across threads for large images.
+// Colors are numbered in order of first appearance, so the SBU output does not depend on the
+// hash layout or the thread count. The color-to-index map is handed back in indexMap so
+// encoders can look up each pixel in constant time. The palette and the map are allocated
+// from arena.
+int build_color_palette(Image *image, Arena *arena, RGBPixel **palette, int *paletteSize, ColorMap *indexMap) {
+    size_t pixelCount = (size_t)image->width * (size_t)image->height;
+    int threads = parallel_worker_count(pixelCount, PARALLEL_PALETTE_MIN_PIXELS);
+    if (threads > image->height) threads = image->height > 0 ? image->height : 1;
+
+    int previous = hw2_stats_stage(HW2_STAGE_PALETTE);
+    PaletteBuilder builder;
+    bool ok = palette_builder_init(&builder, arena) &&
+              (threads > 1 ? build_palette_parallel(image, &builder, threads)
+                           : palette_builder_add(&builder, image->pixels, pixelCount));
+    hw2_stats_stage(previous);
+    if (!ok) return -1;
+
+    *palette = builder.colors;
+    *paletteSize = builder.size;
+    *indexMap = builder.map;
+    if (hw2ActiveStats != NULL) hw2ActiveStats->paletteSize = builder.size;
+    return *paletteSize;
+}
+
+// Images without an arena build into a scratch arena and get a malloc'd copy of the palette.
+int calculate_color_palette(Image *image, RGBPixel **palette, int *paletteSize) {
+    Arena scratch = {0};
+    ColorMap map;
+    bool ok = build_color_palette(image, image->arena ? image->arena : &scratch, palette, paletteSize, &map) >= 0;
+    if (ok && !image->arena) {
+        RGBPixel *copy = malloc((size_t)*paletteSize * sizeof(RGBPixel));
+        if (copy != NULL) memcpy(copy, *palette, (size_t)*paletteSize * sizeof(RGBPixel));
+        *palette = copy;
+        ok = copy != NULL;
+    }
+    free_arena(&scratch);
+    if (!ok) {
+        hw2_fail(HW2_ERROR_MEMORY, "Unable to allocate memory for color palette.");
+        return -1;
+    }
+    return *paletteSize;
+}
+
+#define WRITE_BUFFER_SIZE (1 << 20)
+#define WRITER_MAX_TOKEN 32
+
+// Output counterpart of TextScanner: text is formatted into a large buffer that is flushed
+// with one fwrite per block. Write errors are remembered and reported by writer_close. Writers
+// of output files (output set) count their bytes and time under the write stage; the memory
+// streams of parallel encoders do not. A writer with temporary set writes to that file and
+// renames it over target when it closes without a failure.
+typedef struct {
+    FILE *file;
+    char *buffer;
+    size_t len;
+    bool failed, output;
+    char *temporary;
+    const char *target;
+} TextWriter;
+
+// Takes over an open file; writer_close closes it. On failure the file stays with the caller.
+bool writer_attach(TextWriter *writer, FILE *file) {
+    writer->file = file;
+    writer->buffer = malloc(WRITE_BUFFER_SIZE);
+    if (!writer->buffer) return false;
+    writer->len = 0;
+    writer->failed = false;
+    writer->output = false;
+    writer->temporary = NULL;
+    return true;
+}
+
+bool writer_open(TextWriter *writer, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) return false;
+    if (!writer_attach(writer, file)) {
+        fclose(file);
+        return false;
+    }
+    writer->output = true;
+    return true;
+}
+
+// Opens a new file next to filename that takes its place on writer_close, for output that
+// replaces a file still being read. It gets the permissions of the file it replaces.
+bool writer_open_replacing(TextWriter *writer, const char *filename) {
+    struct stat st;
+    size_t length = strlen(filename);
+    char *temporary = malloc(length + sizeof(".XXXXXX"));
+    if (temporary == NULL || stat(filename, &st) != 0) {
+        free(temporary);
+        return false;
+    }
+    memcpy(temporary, filename, length);
+    memcpy(temporary + length, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int fd = mkstemp(temporary);
+    FILE *file = fd >= 0 && fchmod(fd, st.st_mode & 07777) == 0 ? fdopen(fd, "w") : NULL;
+    if (file == NULL || !writer_attach(writer, file)) {
+        if (file != NULL) fclose(file);
+        else if (fd >= 0) close(fd);
+        if (fd >= 0) unlink(temporary);
+        free(temporary);
+        return false;
+    }
+    writer->output = true;
+    writer->temporary = temporary;
+    writer->target = filename;
+    return true;
+}
+
+// True when both paths name the same existing file.
+static bool same_file(const char *a, const char *b) {
+    struct stat stA, stB;
+    return stat(a, &stA) == 0 && stat(b, &stB) == 0 && stA.st_dev == stB.st_dev && stA.st_ino == stB.st_ino;
+}
+
+// Hands size bytes to the file.
+static void writer_write(TextWriter *writer, const void *data, size_t size) {
+    int previous = writer->output ? hw2_stats_stage(HW2_STAGE_WRITE) : HW2_STAGE_NONE;
+    size_t written = fwrite(data, 1, size, writer->file);
+    if (written != size) writer->failed = true;
+    if (writer->output) {
+        HW2_STATS_ADD(bytesWritten, written);
+        hw2_stats_stage(previous);
+    }
+}
+
+void writer_flush(TextWriter *writer) {
+    if (writer->len > 0) writer_write(writer, writer->buffer, writer->len);
+    writer->len = 0;
+}
+
+// Flushes and closes the file. Returns false if any write failed.
+bool writer_close(TextWriter *writer) {
+    writer_flush(writer);
+    int previous = writer->output ? hw2_stats_stage(HW2_STAGE_WRITE) : HW2_STAGE_NONE;
+    if (fclose(writer->file) != 0) writer->failed = true;
+    if (writer->temporary != NULL) {
+        if (writer->failed || rename(writer->temporary, writer->target) != 0) {
+            writer->failed = true;
+            unlink(writer->temporary);
+        }
+        free(writer->temporary);
+    }
+    if (writer->output) hw2_stats_stage(previous);
+    free(writer->buffer);
+    return !writer->failed;
+}
+
+// Writes size bytes of already formatted text after everything buffered so far.
+void writer_put_block(TextWriter *writer, const void *data, size_t size) {
+    writer_flush(writer);
+    if (size > 0) writer_write(writer, data, size);
+}
+
+// Makes room for at least n more bytes.
+static inline void writer_reserve(TextWriter *writer, size_t n) {
+    if (writer->len + n > WRITE_BUFFER_SIZE) writer_flush(writer);
+}
+
+static inline void writer_put_char(TextWriter *writer, char ch) {
+    writer_reserve(writer, 1);
+    writer->buffer[writer->len++] = ch;
+}
+
+static inline void writer_put_string(TextWriter *writer, const char *text) {
+    size_t n = strlen(text);
+    writer_reserve(writer, n);
+    memcpy(writer->buffer + writer->len, text, n);
+    writer->len += n;
+}
+
+// Appends value in decimal followed by the separator.
+static inline void writer_put_uint(TextWriter *writer, size_t value, char separator) {
+    char digits[WRITER_MAX_TOKEN];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    writer_reserve(writer, (size_t)n + 1);
+    char *out = writer->buffer + writer->len;
+    for (int k = 0; k < n; k++) out[k] = digits[n - 1 - k];
+    out[n] = separator;
+    writer->len += (size_t)n + 1;
+}
+
+// Decimal text of every component value, padded with spaces to four bytes. A whole entry is
+// copied per value and the output advances by digits + 1, leaving exactly one space behind.
+static const char DECIMAL_TEXT[256][4] = {
+    "0   ", "1   ", "2   ", "3   ", "4   ", "5   ", "6   ", "7   ",
+    "8   ", "9   ", "10  ", "11  ", "12  ", "13  ", "14  ", "15  ",
+    "16  ", "17  ", "18  ", "19  ", "20  ", "21  ", "22  ", "23  ",
+    "24  ", "25  ", "26  ", "27  ", "28  ", "29  ", "30  ", "31  ",
+    "32  ", "33  ", "34  ", "35  ", "36  ", "37  ", "38  ", "39  ",
+    "40  ", "41  ", "42  ", "43  ", "44  ", "45  ", "46  ", "47  ",
+    "48  ", "49  ", "50  ", "51  ", "52  ", "53  ", "54  ", "55  ",
+    "56  ", "57  ", "58  ", "59  ", "60  ", "61  ", "62  ", "63  ",
+    "64  ", "65  ", "66  ", "67  ", "68  ", "69  ", "70  ", "71  ",
+    "72  ", "73  ", "74  ", "75  ", "76  ", "77  ", "78  ", "79  ",
+    "80  ", "81  ", "82  ", "83  ", "84  ", "85  ", "86  ", "87  ",
+    "88  ", "89  ", "90  ", "91  ", "92  ", "93  ", "94  ", "95  ",
+    "96  ", "97  ", "98  ", "99  ", "100 ", "101 ", "102 ", "103 ",
+    "104 ", "105 ", "106 ", "107 ", "108 ", "109 ", "110 ", "111 ",
+    "112 ", "113 ", "114 ", "115 ", "116 ", "117 ", "118 ", "119 ",
+    "120 ", "121 ", "122 ", "123 ", "124 ", "125 ", "126 ", "127 ",
+    "128 ", "129 ", "130 ", "131 ", "132 ", "133 ", "134 ", "135 ",
+    "136 ", "137 ", "138 ", "139 ", "140 ", "141 ", "142 ", "143 ",
+    "144 ", "145 ", "146 ", "147 ", "148 ", "149 ", "150 ", "151 ",
+    "152 ", "153 ", "154 ", "155 ", "156 ", "157 ", "158 ", "159 ",
+    "160 ", "161 ", "162 ", "163 ", "164 ", "165 ", "166 ", "167 ",
+    "168 ", "169 ", "170 ", "171 ", "172 ", "173 ", "174 ", "175 ",
+    "176 ", "177 ", "178 ", "179 ", "180 ", "181 ", "182 ", "183 ",
+    "184 ", "185 ", "186 ", "187 ", "188 ", "189 ", "190 ", "191 ",
+    "192 ", "193 ", "194 ", "195 ", "196 ", "197 ", "198 ", "199 ",
+    "200 ", "201 ", "202 ", "203 ", "204 ", "205 ", "206 ", "207 ",
+    "208 ", "209 ", "210 ", "211 ", "212 ", "213 ", "214 ", "215 ",
+    "216 ", "217 ", "218 ", "219 ", "220 ", "221 ", "222 ", "223 ",
+    "224 ", "225 ", "226 ", "227 ", "228 ", "229 ", "230 ", "231 ",
+    "232 ", "233 ", "234 ", "235 ", "236 ", "237 ", "238 ", "239 ",
+    "240 ", "241 ", "242 ", "243 ", "244 ", "245 ", "246 ", "247 ",
+    "248 ", "249 ", "250 ", "251 ", "252 ", "253 ", "254 ", "255 ",
+};
+
+static inline size_t decimal_width(unsigned char value) {
+    return 2 + (value >= 10) + (value >= 100);
+}
+
+// Appends a 0-255 value followed by a space.
+static inline void writer_put_byte(TextWriter *writer, unsigned char value) {
+    writer_reserve(writer, 4);
+    memcpy(writer->buffer + writer->len, DECIMAL_TEXT[value], 4);
+    writer->len += decimal_width(value);
+}
+
+void ppm_write_header(TextWriter *writer, int width, int height, bool raw) {
+    writer_put_string(writer, raw ? "P6\n" : "P3\n");
+    writer_put_uint(writer, (size_t)width, ' ');
+    writer_put_uint(writer, (size_t)height, '\n');
+    writer_put_string(writer, "255\n");
+}
+
+// Appends whole rows of pixels. Raw (P6) rows bypass the buffer and go out in one fwrite.
+// Plain (P3) rows are written as "r g b " per pixel and a newline per row, the layout of
+// tests/images/*.ppm; pixels are formatted from DECIMAL_TEXT straight into the writer buffer,
+// a chunk of a row at a time, so each block goes out with one fwrite.
+void ppm_write_rows(TextWriter *writer, const RGBPixel *pixels, int width, int rows, bool raw) {
+    if (raw) {
+        writer_put_block(writer, pixels, (size_t)width * (size_t)rows * sizeof(RGBPixel));
+        return;
+    }
+
+    const size_t chunkPixels = WRITE_BUFFER_SIZE / 16;
+    for (int row = 0; row < rows; row++) {
+        const unsigned char *component = (const unsigned char *)(pixels + (size_t)row * width);
+        size_t remaining = (size_t)width;
+        while (remaining > 0) {
+            size_t chunk = remaining < chunkPixels ? remaining : chunkPixels;
+            writer_reserve(writer, chunk * 12 + 4);
+            char *out = writer->buffer + writer->len;
+            for (size_t k = 0; k < chunk * 3; k++) {
+                memcpy(out, DECIMAL_TEXT[component[k]], 4);
+                out += decimal_width(component[k]);
+            }
+            writer->len = (size_t)(out - writer->buffer);
+            component += chunk * 3;
+            remaining -= chunk;
+        }
+        writer_put_char(writer, '\n');
+    }
+}
+
+// Opening filename for writing truncates it, which would pull the pages out from under an
+// image mapped from that same file; such an image first gets its pixels copied out.
+static bool unmap_before_overwrite(Image *image, const char *filename) {
+    struct stat st;
+    if (image->mapping == NULL || stat(filename, &st) != 0 || st.st_dev != image->mappedDevice ||
+        st.st_ino != image->mappedInode) {
+        return true;
+    }
+    RGBPixel *mapped = image->pixels;
+    size_t size = (size_t)image->width * (size_t)image->height * sizeof(RGBPixel);
+    if (!reserve_pixels(image, size / sizeof(RGBPixel))) {
+        image->pixels = mapped;
+        return hw2_fail(HW2_ERROR_MEMORY, "Memory allocation failed.");
+    }
+    memcpy(image->pixels, mapped, size);
+    munmap(image->mapping, image->mappingSize);
+    image->mapping = NULL;
+    return true;
+}
+
+bool save_ppm_format(const char *filename, Image *image, bool raw) {
+    int previous = hw2_stats_stage(HW2_STAGE_ENCODE);
+    TextWriter writer;
+    bool ok = unmap_before_overwrite(image, filename) &&
+              (writer_open(&writer, filename) ||
+               hw2_fail(HW2_ERROR_OPEN, "Unable to open file for writing: %s", strerror(errno)));
+    if (ok) {
+        ppm_write_header(&writer, image->width, image->height, raw);
+        ppm_write_rows(&writer, image->pixels, image->width, image->height, raw);
+        ok = writer_close(&writer) || hw2_fail(HW2_ERROR_WRITE, "Unable to write file: %s", strerror(errno));
+    }
+    hw2_stats_stage(previous);
+    return ok;
+}
+
+// Writes a plain (P3) PPM.
+int save_ppm(const char *filename, Image *image) {
+    return hw2_status(save_ppm_format(filename, image, false));
+}
+
+// Writes a raw (P6) PPM: the text header followed by the pixel array in a single fwrite.
+int save_ppm_raw(const char *filename, Image *image) {
+    return hw2_status(save_ppm_format(filename, image, true));
+}
+
+// Runs of at least this many identical pixels are written as "*count index" tokens.
+#ifndef SBU_MIN_RUN_LENGTH
+#define SBU_MIN_RUN_LENGTH 2
+#endif
+
+void sbu_write_header(TextWriter *writer, int width, int height, const RGBPixel *palette, int paletteSize) {
+    writer_put_string(writer, "SBU\n");
+    writer_put_uint(writer, (size_t)width, ' ');
+    writer_put_uint(writer, (size_t)height, '\n');
+    writer_put_uint(writer, (size_t)paletteSize, '\n');
+    for (int i = 0; i < paletteSize; i++) {
+        writer_put_byte(writer, palette[i].r);
+        writer_put_byte(writer, palette[i].g);
+        writer_put_byte(writer, palette[i].b);
+    }
+    writer_put_char(writer, '\n');
+}
+
+// Incremental SBU index stream writer. The current run is carried between calls, so pixels can
+// be fed a band at a time and runs that cross band boundaries still come out as one token.
+typedef struct {
+    TextWriter *writer;
+    const ColorMap *indexMap;
+    uint32_t runKey;
+    size_t runLength;
+    size_t minRunLength;
+    size_t runs;
+} SbuEncoder;
+
+// Values of minRunLength below 2 are treated as 2; pass INT_MAX to write every index individually.
+void sbu_encoder_init(SbuEncoder *encoder, TextWriter *writer, const ColorMap *indexMap, int minRunLength) {
+    encoder->writer = writer;
+    encoder->indexMap = indexMap;
+    encoder->runKey = COLOR_MAP_EMPTY;
+    encoder->runLength = 0;
+    encoder->minRunLength = minRunLength < 2 ? 2 : (size_t)minRunLength;
+    encoder->runs = 0;
+}
+
+static void sbu_encoder_emit(SbuEncoder *encoder) {
+    if (encoder->runLength == 0) return;
+    size_t index = (size_t)color_map_find(encoder->indexMap, encoder->runKey);
+    if (encoder->runLength >= encoder->minRunLength) {
+        writer_put_char(encoder->writer, '*');
+        writer_put_uint(encoder->writer, encoder->runLength, ' ');
+        writer_put_uint(encoder->writer, index, ' ');
+        encoder->runs++;
+    } else {
+        for (size_t k = 0; k < encoder->runLength; k++) writer_put_uint(encoder->writer, index, ' ');
+    }
+    encoder->runLength = 0;
+}
+
+#define SBU_SHORT_RUN 8
+
+void sbu_encoder_add(SbuEncoder *encoder, const RGBPixel *pixels, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        uint32_t key = pack_rgb(pixels[i]);
+        // Runs in photos are mostly a few pixels long; only longer ones go to the vector scan.
+        size_t run = 1;
+        while (run < SBU_SHORT_RUN && i + run < count && pack_rgb(pixels[i + run]) == key) run++;
+        if (run == SBU_SHORT_RUN) run = hw2_run_length((const unsigned char *)(pixels + i), count - i);
+
+        if (encoder->runLength == 0 || key != encoder->runKey) {
+            sbu_encoder_emit(encoder);
+            encoder->runKey = key;
+        }
+        encoder->runLength += run;
+        i += run;
+    }
+}
+
+void sbu_encoder_finish(SbuEncoder *encoder) {
+    sbu_encoder_emit(encoder);
+}
+
+// Parallel encoding of the SBU index stream. The pixels are cut into one stripe per thread,
+// with every cut moved forward to where the color changes, so no run crosses a stripe and each
+// stripe encodes exactly as the serial encoder would. Stripes are formatted into memory streams
+// and written out in order.
+typedef struct {
+    const RGBPixel *pixels;
+    const ColorMap *indexMap;
+    int minRunLength;
+    size_t *bounds;
+    char **texts;
+    size_t *sizes;
+    bool *encoded;
+    size_t runs;
+} SbuStripes;
+
+static void sbu_stripe_task(void *context, int index) {
+    SbuStripes *stripes = context;
+    TextWriter writer;
+    FILE *stream = open_memstream(&stripes->texts[index], &stripes->sizes[index]);
+    if (stream == NULL || !writer_attach(&writer, stream)) {
+        if (stream != NULL) fclose(stream);
+        stripes->encoded[index] = false;
+        return;
+    }
+
+    SbuEncoder encoder;
+    sbu_encoder_init(&encoder, &writer, stripes->indexMap, stripes->minRunLength);
+    sbu_encoder_add(&encoder, stripes->pixels + stripes->bounds[index],
+                    stripes->bounds[index + 1] - stripes->bounds[index]);
+    sbu_encoder_finish(&encoder);
+    __atomic_add_fetch(&stripes->runs, encoder.runs, __ATOMIC_RELAXED);
+    stripes->encoded[index] = writer_close(&writer);
+}
+
+bool sbu_encode_parallel(TextWriter *writer, const RGBPixel *pixels, size_t count, const ColorMap *indexMap,
+                         int minRunLength, int threads) {
+    SbuStripes stripes = {pixels, indexMap, minRunLength, malloc((size_t)(threads + 1) * sizeof(size_t)),
+                          calloc((size_t)threads, sizeof(char *)), calloc((size_t)threads, sizeof(size_t)),
+                          calloc((size_t)threads, sizeof(bool)), 0};
+    bool ok = stripes.bounds != NULL && stripes.texts != NULL && stripes.sizes != NULL && stripes.encoded != NULL;
+    if (ok) {
+        size_t *bounds = stripes.bounds;
+        bounds[0] = 0;
+        for (int i = 1; i < threads; i++) {
+            size_t bound = count / (size_t)threads * (size_t)i;
+            if (bound < bounds[i - 1]) bound = bounds[i - 1];
+            // Move past the rest of the run the cut falls into.
+            if (bound > 0 && bound < count) {
+                bound += hw2_run_length((const unsigned char *)(pixels + bound - 1), count - bound + 1) - 1;
+            }
+            bounds[i] = bound;
+        }
+        bounds[threads] = count;
+
+        parallel_for(threads, sbu_stripe_task, &stripes);
+        HW2_STATS_ADD(rleRuns, stripes.runs);
+        hw2_stats_sample_heap();
+        for (int i = 0; i < threads; i++) {
+            ok = ok && stripes.encoded[i];
+            if (ok) writer_put_block(writer, stripes.texts[i], stripes.sizes[i]);
+        }
+    }
+
+    for (int i = 0; stripes.texts != NULL && i < threads; i++) free(stripes.texts[i]);
+    free(stripes.bounds);
+    free(stripes.texts);
+    free(stripes.sizes);
+    free(stripes.encoded);
+    return ok;
+}
+
+// Writes the text SBU format that load_sbu reads: header, color table, then the index stream
+// with runs of minRunLength or more identical pixels collapsed into "*count index" tokens.
+static bool sbu_write_file(const char *filename, Image *image, Arena *arena, int minRunLength) {
+    if (!unmap_before_overwrite(image, filename)) return false;
+    TextWriter writer;
+    if (!writer_open(&writer, filename)) {
+        return hw2_fail(HW2_ERROR_OPEN, "Unable to open file for writing: %s", strerror(errno));
+    }
+
+    int paletteSize = 0;
+    RGBPixel *palette = NULL;
+    ColorMap indexMap;
+    if (build_color_palette(image, arena, &palette, &paletteSize, &indexMap) < 0) {
+        hw2_fail(HW2_ERROR_MEMORY, "Unable to allocate memory for color palette.");
+        writer_close(&writer);
+        return false;
+    }
+
+    sbu_write_header(&writer, image->width, image->height, palette, paletteSize);
+    size_t pixelCount = (size_t)image->width * (size_t)image->height;
+    int threads = parallel_worker_count(pixelCount, PARALLEL_PALETTE_MIN_PIXELS);
+    bool encoded = true;
+    if (threads > 1) {
+        encoded = sbu_encode_parallel(&writer, image->pixels, pixelCount, &indexMap, minRunLength, threads);
+    } else {
+        SbuEncoder encoder;
+        sbu_encoder_init(&encoder, &writer, &indexMap, minRunLength);
+        sbu_encoder_add(&encoder, image->pixels, pixelCount);
+        sbu_encoder_finish(&encoder);
+        HW2_STATS_ADD(rleRuns, encoder.runs);
+    }
+
+    if (!writer_close(&writer) || !encoded) {
+        return hw2_fail(HW2_ERROR_WRITE, "Unable to write file: %s", strerror(errno));
+    }
+    return true;
+}
+
+// The palette and its map come from the image's arena, or from a scratch arena freed here.
+bool save_sbu_rle(const char *filename, Image *image, int minRunLength) {
+    int previous = hw2_stats_stage(HW2_STAGE_ENCODE);
+    Arena scratch = {0};
+    bool ok = sbu_write_file(filename, image, image->arena ? image->arena : &scratch, minRunLength);
+    free_arena(&scratch);
+    hw2_stats_stage(previous);
+    return ok;
+}
+
+int save_sbu(const char *filename, Image *image) {
+    return hw2_status(save_sbu_rle(filename, image, SBU_MIN_RUN_LENGTH));
+}
+
+// Where the SBU index decoder stands between tokens: expecting an index or a '*' marker, the
+// length of a run, the index of a run, or with part of a run still to be filled.
+typedef enum { SBU_STATE_TOKEN, SBU_STATE_RUN_LENGTH, SBU_STATE_RUN_INDEX, SBU_STATE_RUN_FILL } SbuState;
+
+// Band-at-a-time reader for conversions that never hold the whole image. PPM pixel data is
+// decoded straight from the scanner; SBU keeps only the color table, allocated from arena, and
+// the decoder state, including the unfinished part of the current "*count index" run, between
+// calls.
+typedef struct {
+    TextScanner scanner;
+    Arena *arena;
+    bool sbu, raw;
+    int width, height;
+    RGBPixel *colorTable;
+    int entries;
+    SbuState state;
+    size_t position;
+    size_t pendingRun;
+    RGBPixel runColor;
+} ImageReader;
+
+bool sbu_read_header(ImageReader *reader) {
+    TextScanner *scanner = &reader->scanner;
+    if (scanner->len == 0) scanner_refill(scanner);
+    if (!scanner_skip_space(scanner) || scanner->len - scanner->pos < 4 ||
+        memcmp(scanner->buffer + scanner->pos, "SBU", 3) != 0 || !is_space(scanner->buffer[scanner->pos + 3])) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Invalid SBU file format.");
+    }
+    scanner->pos += 3;
+
+    if (!scanner_read_uint(scanner, &reader->width) || !scanner_read_uint(scanner, &reader->height) ||
+        reader->width <= 0 || reader->height <= 0) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Failed to read image dimensions.");
+    }
+    if (!scanner_read_uint(scanner, &reader->entries)) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Failed to read the number of color table entries.");
+    }
+
+    reader->colorTable = arena_allocate(reader->arena, ((size_t)reader->entries + 1) * sizeof(RGBPixel));
+    if (!reader->colorTable) {
+        return hw2_fail(HW2_ERROR_MEMORY, "Unable to allocate memory for color table.");
+    }
+    size_t components = scanner_read_bytes(scanner, (unsigned char *)reader->colorTable, (size_t)reader->entries * 3, 255);
+    if (components != (size_t)reader->entries * 3) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Failed to read color table entry %zu.", components / 3);
+    }
+    return true;
+}
+
+// Indexes decoded per call to the vector decoder when no run is pending.
+#define SBU_INDEX_BATCH 256
+
+// Reports why the token at the scanner position could not be used as an SBU index or run length.
+static bool sbu_token_error(ImageReader *reader, const char *what) {
+    if (scanner_skip_space(&reader->scanner)) {
+        hw2_fail(HW2_ERROR_FORMAT, "Invalid %s at pixel %zu in SBU pixel data.", what, reader->position);
+    } else {
+        hw2_fail(HW2_ERROR_FORMAT, "SBU pixel data ends early at pixel %zu.", reader->position);
+    }
+    return false;
+}
+
+// Decodes the next count pixels of the index stream. The decoder is a small state machine over
+// the scanner buffer so that a run may be split across calls; runs are expanded with one bulk
+// fill of their color, and plain indexes are decoded by the vector decoder a batch at a time.
+bool sbu_read_pixels(ImageReader *reader, RGBPixel *out, size_t count) {
+    TextScanner *scanner = &reader->scanner;
+    uint32_t indexes[SBU_INDEX_BATCH];
+    uint32_t maxIndex = (uint32_t)reader->entries - 1;
+    size_t done = 0;
+    int value;
+    while (done < count) {
+        switch (reader->state) {
+        case SBU_STATE_TOKEN: {
+            if (!scanner_skip_space(scanner) || reader->entries == 0) return sbu_token_error(reader, "color index");
+            if (scanner->buffer[scanner->pos] == '*') {
+                scanner->pos++;
+                reader->state = SBU_STATE_RUN_LENGTH;
+                break;
+            }
+            size_t wanted = count - done < SBU_INDEX_BATCH ? count - done : SBU_INDEX_BATCH;
+            size_t got = scanner_read_uints(scanner, indexes, wanted, maxIndex);
+            for (size_t k = 0; k < got; k++) out[done + k] = reader->colorTable[indexes[k]];
+            done += got;
+            reader->position += got;
+            // A short batch must have stopped in front of a run marker.
+            if (got < wanted && (scanner->pos == scanner->len || scanner->buffer[scanner->pos] != '*')) {
+                return sbu_token_error(reader, "color index");
+            }
+            break;
+        }
+        case SBU_STATE_RUN_LENGTH:
+            if (!scanner_read_uint(scanner, &value) || value < 1) return sbu_token_error(reader, "run length");
+            reader->pendingRun = (size_t)value;
+            reader->state = SBU_STATE_RUN_INDEX;
+            break;
+        case SBU_STATE_RUN_INDEX:
+            if (!scanner_read_uint(scanner, &value) || value >= reader->entries) {
+                return sbu_token_error(reader, "color index");
+            }
+            reader->runColor = reader->colorTable[value];
+            reader->state = SBU_STATE_RUN_FILL;
+            break;
+        case SBU_STATE_RUN_FILL: {
+            size_t n = count - done < reader->pendingRun ? count - done : reader->pendingRun;
+            hw2_fill_pixels((unsigned char *)(out + done), n, reader->runColor.r, reader->runColor.g,
+                            reader->runColor.b);
+            done += n;
+            reader->position += n;
+            reader->pendingRun -= n;
+            if (reader->pendingRun == 0) reader->state = SBU_STATE_TOKEN;
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+void image_reader_close(ImageReader *reader) {
+    scanner_close(&reader->scanner);
+}
+
+// Opens a .ppm or .sbu file and parses everything up to the first pixel.
+bool image_reader_open(ImageReader *reader, const char *filename, Arena *arena) {
+    const char *extension = strrchr(filename, '.');
+    if (extension == NULL || (strcmp(extension, ".ppm") != 0 && strcmp(extension, ".sbu") != 0)) {
+        return hw2_fail(HW2_ERROR_FORMAT, "Unsupported input file format.");
+    }
+    // Streaming reads through the block buffer rather than a mapping, so resident memory does
+    // not grow with the file as it is consumed.
+    if (!scanner_open_buffered(&reader->scanner, filename)) {
+        return hw2_fail(HW2_ERROR_OPEN, "Unable to open file: %s", strerror(errno));
+    }
+
+    reader->arena = arena;
+    reader->sbu = strcmp(extension, ".sbu") == 0;
+    reader->raw = false;
+    reader->colorTable = NULL;
+    reader->state = SBU_STATE_TOKEN;
+    reader->position = 0;
+    reader->pendingRun = 0;
+    bool ok;
+    if (reader->sbu) {
+        ok = sbu_read_header(reader);
+    } else {
+        ok = ppm_read_header(&reader->scanner, &reader->width, &reader->height, &reader->raw);
+        if (reader->raw && reader->scanner.pos < reader->scanner.len) reader->scanner.pos++;
+    }
+    if (!ok) image_reader_close(reader);
+    return ok;
+}
+
+// Reads the next count pixels in row-major order.
+bool image_reader_read(ImageReader *reader, RGBPixel *out, size_t count) {
+    int previous = hw2_stats_stage(HW2_STAGE_LOAD);
+    bool ok;
+    if (reader->sbu) {
+        ok = sbu_read_pixels(reader, out, count);
+    } else {
+        size_t components = reader->raw
+            ? scanner_read_raw(&reader->scanner, out, count * 3)
+            : scanner_read_bytes(&reader->scanner, (unsigned char *)out, count * 3, 255);
+        ok = components == count * 3 || hw2_fail(HW2_ERROR_FORMAT, "Error reading pixel data.");
+    }
+    hw2_stats_stage(previous);
+    return ok;
+}
+
+// Loads a whole SBU file through the same header and index decoding as the streaming reader.
+static int read_sbu_file(const char *filename, Image *image, Arena *arena) {
+    release_image(image);
+    ImageReader reader = {.arena = arena};
+    if (!scanner_open(&reader.scanner, filename, false)) {
+        return hw2_error(HW2_ERROR_OPEN, "Unable to open file: %s", strerror(errno));
+    }
+    if (!sbu_read_header(&reader)) {
+        image_reader_close(&reader);
+        return hw2_status(false);
+    }
+
+    image->width = reader.width;
+    image->height = reader.height;
+    if (!reserve_pixels(image, (size_t)image->width * (size_t)image->height)) {
+        hw2_fail(HW2_ERROR_MEMORY, "Unable to allocate memory for pixels.");
+        image_reader_close(&reader);
+        return hw2_status(false);
+    }
+
+    bool ok = sbu_read_pixels(&reader, image->pixels, (size_t)image->width * (size_t)image->height);
+    if (ok && reader.pendingRun > 0) {
+        hw2_fail(HW2_ERROR_FORMAT, "SBU run extends %zu pixels past the end of the image.", reader.pendingRun);
+        ok = false;
+    }
+    if (!ok) image->pixels = NULL;
+    image_reader_close(&reader);
+    return hw2_status(ok);
+}
+
+int load_sbu(const char *filename, Image *image) {
+    int previous = hw2_stats_stage(HW2_STAGE_LOAD);
+    Arena scratch = {0};
+    int status = read_sbu_file(filename, image, image->arena ? image->arena : &scratch);
+    free_arena(&scratch);
+    if (status == HW2_OK) HW2_STATS_ADD(pixels, (uint64_t)image->width * (uint64_t)image->height);
+    hw2_stats_stage(previous);
+    return status;
+}
+
+// Band size for streaming conversion; can be overridden at compile time.
+#ifndef STREAM_BAND_BYTES
+#define STREAM_BAND_BYTES (4 << 20)
+#endif
+
+// The part of a streamed copy/paste that is left after clipping, as move_region clips it, and
+// the copied pixels. width is 0 when nothing moves.
+typedef struct {
+    int width, height, sourceRow, sourceCol, destRow, destCol;
+    RGBPixel *pixels;
+} StreamPaste;
+
+static void stream_paste_clip(StreamPaste *paste, const StreamEdits *edits, int width, int height) {
+    memset(paste, 0, sizeof(*paste));
+    if (edits == NULL || !edits->copy) return;
+    Rect source = edits->source;
+    if (source.row >= height || source.col >= width || edits->pasteRow >= height || edits->pasteCol >= width) return;
+    if (source.row == edits->pasteRow && source.col == edits->pasteCol) return;
+
+    if (source.width > width - source.col) source.width = width - source.col;
+    if (source.height > height - source.row) source.height = height - source.row;
+    if (source.width > width - edits->pasteCol) source.width = width - edits->pasteCol;
+    if (source.height > height - edits->pasteRow) source.height = height - edits->pasteRow;
+    if (source.width <= 0 || source.height <= 0) return;
+    *paste = (StreamPaste){source.width, source.height, source.row, source.col, edits->pasteRow, edits->pasteCol, NULL};
+}
+
+// Reads the input up to the last copied row and keeps the copied pixels, which the paste
+// needs before the first band it lands on is written.
+static bool stream_paste_capture(StreamPaste *paste, ImageReader *reader, RGBPixel *band, int bandRows, Arena *arena) {
+    size_t stride = (size_t)reader->width, rowBytes = (size_t)paste->width * sizeof(RGBPixel);
+    paste->pixels = arena_allocate(arena, (size_t)paste->height * rowBytes);
+    if (paste->pixels == NULL) return hw2_fail(HW2_ERROR_MEMORY, "Memory allocation failed.");
+
+    int end = paste->sourceRow + paste->height;
+    for (int row = 0; row < end; row += bandRows) {
+        int rows = end - row < bandRows ? end - row : bandRows;
+        if (!image_reader_read(reader, band, (size_t)rows * stride)) return false;
+        for (int r = row > paste->sourceRow ? row : paste->sourceRow; r < row + rows; r++) {
+            memcpy(paste->pixels + (size_t)(r - paste->sourceRow) * (size_t)paste->width,
+                   band + (size_t)(r - row) * stride + (size_t)paste->sourceCol, rowBytes);
+        }
+    }
+    return true;
+}
+
+// Makes the edits on the rows [row, row + rows) held in band.
+static void stream_edit_band(const StreamPaste *paste, const StreamEdits *edits, RGBPixel *band, int width, int row,
+                             int rows) {
+    if (paste->width > 0) {
+        int previous = hw2_stats_stage(HW2_STAGE_COPY_PASTE);
+        int first = row > paste->destRow ? row : paste->destRow;
+        int last = row + rows < paste->destRow + paste->height ? row + rows : paste->destRow + paste->height;
+        for (int r = first; r < last; r++) {
+            memcpy(band + (size_t)(r - row) * (size_t)width + (size_t)paste->destCol,
+                   paste->pixels + (size_t)(r - paste->destRow) * (size_t)paste->width,
+                   (size_t)paste->width * sizeof(RGBPixel));
+        }
+        hw2_stats_stage(previous);
+    }
+    if (edits != NULL && edits->atlas != NULL) {
+        Image image = {.width = width, .height = rows, .pixels = band};
+        render_text_band(&image, row, edits->atlas, edits->message, edits->textRow, edits->textCol);
+    }
+}
+
+// Converts between formats without holding the whole image: pixels pass through one band of
+// rows at a time, so memory stays at STREAM_BAND_BYTES plus the palette and the copied region.
+// A copy is captured in a first read up to its last row. SBU output needs its palette before
+// the first index, so the input is then read twice: once to build the palette and once to
+// encode, both times with the edits made on each band. The band, the copied region, the
+// palette and the SBU color tables are allocated from arena.
+static int convert_bands(const char *inputFile, const char *outputFile, bool rawPpm, const StreamEdits *edits,
+                         Arena *arena) {
+    const char *extension = strrchr(outputFile, '.');
+    if (extension == NULL || (strcmp(extension, ".ppm") != 0 && strcmp(extension, ".sbu") != 0)) {
+        return hw2_error(HW2_ERROR_FORMAT, "Unsupported output file format.");
+    }
+    bool sbuOutput = strcmp(extension, ".sbu") == 0;
+
+    ImageReader reader;
+    if (!image_reader_open(&reader, inputFile, arena)) return hw2_status(false);
+    int width = reader.width, height = reader.height;
+    int bandRows = (int)(STREAM_BAND_BYTES / ((size_t)width * sizeof(RGBPixel)));
+    if (bandRows < 1) bandRows = 1;
+    if (bandRows > height) bandRows = height;
+
+    RGBPixel *band = arena_allocate(arena, (size_t)bandRows * (size_t)width * sizeof(RGBPixel));
+    PaletteBuilder palette = {0};
+    bool ok = band != NULL || hw2_fail(HW2_ERROR_MEMORY, "Memory allocation failed.");
+
+    StreamPaste paste;
+    stream_paste_clip(&paste, edits, width, height);
+    if (ok && paste.width > 0) {
+        ok = stream_paste_capture(&paste, &reader, band, bandRows, arena);
+        image_reader_close(&reader);
+        ok = ok && image_reader_open(&reader, inputFile, arena);
+        if (!ok) return hw2_status(false);
+    }
+
+    if (ok && sbuOutput) {
+        ok = palette_builder_init(&palette, arena) ||
+             hw2_fail(HW2_ERROR_MEMORY, "Unable to allocate memory for color palette.");
+        for (int row = 0; ok && row < height; row += bandRows) {
+            int rows = height - row < bandRows ? height - row : bandRows;
+            size_t count = (size_t)rows * (size_t)width;
+            ok = image_reader_read(&reader, band, count);
+            if (ok) stream_edit_band(&paste, edits, band, width, row, rows);
+            int previous = hw2_stats_stage(HW2_STAGE_PALETTE);
+            if (ok && !palette_builder_add(&palette, band, count)) {
+                ok = hw2_fail(HW2_ERROR_MEMORY, "Unable to allocate memory for color palette.");
+            }
+            hw2_stats_stage(previous);
+        }
+        image_reader_close(&reader);
+        ok = ok && image_reader_open(&reader, inputFile, arena);
+        if (!ok) return hw2_status(false);
+    }
+
+    // The input is read again after the output is opened, so output over the input itself goes
+    // to a new file that replaces it at the end.
+    TextWriter writer;
+    bool replacing = same_file(inputFile, outputFile);
+    if (ok && !(replacing ? writer_open_replacing(&writer, outputFile) : writer_open(&writer, outputFile))) {
+        hw2_fail(HW2_ERROR_OPEN, "Unable to open file for writing: %s", strerror(errno));
+        ok = false;
+    }
+    if (ok) {
+        SbuEncoder encoder;
+        if (sbuOutput) {
+            sbu_write_header(&writer, width, height, palette.colors, palette.size);
+            sbu_encoder_init(&encoder, &writer, &palette.map, SBU_MIN_RUN_LENGTH);
+        } else {
+            ppm_write_header(&writer, width, height, rawPpm);
+        }
+
+        for (int row = 0; ok && row < height; row += bandRows) {
+            int rows = height - row < bandRows ? height - row : bandRows;
+            size_t count = (size_t)rows * (size_t)width;
+            ok = image_reader_read(&reader, band, count);
+            if (!ok) break;
+            stream_edit_band(&paste, edits, band, width, row, rows);
+            if (sbuOutput) sbu_encoder_add(&encoder, band, count);
+            else ppm_write_rows(&writer, band, width, rows, rawPpm);
+        }
+        if (sbuOutput) {
+            sbu_encoder_finish(&encoder);
+            HW2_STATS_ADD(rleRuns, encoder.runs);
+        }
+
+        // A failed conversion leaves the file it would have replaced alone.
+        if (!ok) writer.failed = true;
+        if (!writer_close(&writer) && ok) {
+            hw2_fail(HW2_ERROR_WRITE, "Unable to write file: %s", strerror(errno));
+            ok = false;
+        }
+    }
+
+    if (ok) HW2_STATS_ADD(pixels, (uint64_t)width * (uint64_t)height);
+    if (ok && sbuOutput && hw2ActiveStats != NULL) hw2ActiveStats->paletteSize = palette.size;
+    image_reader_close(&reader);
+    return hw2_status(ok);
+}
+
+// Without an arena the bands and palette go to a scratch arena freed here.
+int convert_streaming(const char *inputFile, const char *outputFile, bool rawPpm, const StreamEdits *edits,
+                      Arena *arena) {
+    int previous = hw2_stats_stage(HW2_STAGE_ENCODE);
+    Arena scratch = {0};
+    int status = convert_bands(inputFile, outputFile, rawPpm, edits, arena ? arena : &scratch);
+    free_arena(&scratch);
+    hw2_stats_stage(previous);
+    return status;
+}
+
+// Picks the loader from the file extension so the input is opened and parsed exactly once.
+// Plain (P3) and raw (P6) PPM are told apart by the magic number. writable must be set when
+// the pixels will be edited after loading.
+int load_image(const char *filename, Image *image, bool writable) {
+    const char *extension = strrchr(filename, '.');
+    if (extension == NULL) {
+        return hw2_error(HW2_ERROR_FORMAT, "Invalid file path.");
+    }
+    if (strcmp(extension, ".ppm") == 0) return load_ppm(filename, image, writable);
+    if (strcmp(extension, ".sbu") == 0) return load_sbu(filename, image);
+    return hw2_error(HW2_ERROR_FORMAT, "Unsupported input file format.");
+}
+
+// Picks the writer from the file extension. rawPpm selects binary P6 over plain P3 for .ppm.
+int save_image(const char *filename, Image *image, bool rawPpm) {
+    const char *extension = strrchr(filename, '.');
+    if (extension != NULL && strcmp(extension, ".ppm") == 0) {
+        return rawPpm ? save_ppm_raw(filename, image) : save_ppm(filename, image);
+    }
+    if (extension != NULL && strcmp(extension, ".sbu") == 0) return save_sbu(filename, image);
+    return hw2_error(HW2_ERROR_FORMAT, "Unsupported output file format.");
+}
+
+// Copies the region of the image given by source to the top-left corner (destRow, destCol).
+// Both rectangles are clipped to the image once up front, then each clipped row is moved
+// with a single memmove. When the destination lies below the source the rows are walked
+// bottom-up, so overlapping regions read every source row before it is overwritten and the
+// result matches copying through a separate clipboard without allocating one.
+static void move_region(Image *image, Rect source, int destRow, int destCol) {
+    if (source.row >= image->height || source.col >= image->width) return;
+    if (destRow >= image->height || destCol >= image->width) return;
+
+    int width = source.width;
+    int height = source.height;
+    if (width > image->width - source.col) width = image->width - source.col;
+    if (height > image->height - source.row) height = image->height - source.row;
+    if (width > image->width - destCol) width = image->width - destCol;
+    if (height > image->height - destRow) height = image->height - destRow;
+
+    size_t stride = (size_t)image->width;
+    size_t rowBytes = (size_t)width * sizeof(RGBPixel);
+    RGBPixel *from = image->pixels + (size_t)source.row * stride + (size_t)source.col;
+    RGBPixel *to = image->pixels + (size_t)destRow * stride + (size_t)destCol;
+    if (to == from) return;
+
+    if (destRow > source.row) {
+        for (int row = height - 1; row >= 0; row--) {
+            memmove(to + (size_t)row * stride, from + (size_t)row * stride, rowBytes);
+        }
+    } else {
+        for (int row = 0; row < height; row++) {
+            memmove(to + (size_t)row * stride, from + (size_t)row * stride, rowBytes);
+        }
+    }
+}
+
+void blit_region(Image *image, Rect source, int destRow, int destCol) {
+    int previous = hw2_stats_stage(HW2_STAGE_COPY_PASTE);
+    move_region(image, source, destRow, destCol);
+    hw2_stats_stage(previous);
+}
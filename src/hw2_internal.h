@@ -0,0 +1,55 @@
+#ifndef HW2_INTERNAL_H
+#define HW2_INTERNAL_H
+
+#include <stdbool.h>
+#include "hw2.h"
+
+// Shared by the library sources only: failure reporting behind hw2_error_message, the hooks
+// that feed hw2_stats_start and arena allocation.
+
+// Records a failure with code and a printf-style description for the calling thread and
+// returns false, so that a failing helper can end with "return hw2_fail(...)".
+bool hw2_fail(int code, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Same as hw2_fail but returns code, for the public functions.
+int hw2_error(int code, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Returns HW2_OK when ok is set, else the code of the last failure on the calling thread.
+int hw2_status(bool ok);
+
+// Statistics being collected on the calling thread (see hw2_stats_start), or NULL.
+extern _Thread_local Hw2Stats *hw2ActiveStats;
+
+// Adds amount to a counter of the statistics being collected, if any.
+#define HW2_STATS_ADD(field, amount)                                   \
+    do {                                                               \
+        if (hw2ActiveStats != NULL) hw2ActiveStats->field += (amount); \
+    } while (0)
+
+// CPU time used so far by the calling thread.
+double hw2_thread_cpu_seconds(void);
+
+// Charges CPU time used by helper threads to the current stage.
+void hw2_stats_add_cpu(double seconds);
+
+// Records the heap in use if it is the most seen so far. Called where large temporaries are
+// about to be freed, so the peak does not fall between two stage changes.
+void hw2_stats_sample_heap(void);
+
+// Returns size bytes from arena, aligned for any type, or NULL if no block could be allocated.
+void *arena_allocate(Arena *arena, size_t size);
+
+// Resizes memory, an allocation of oldSize bytes from arena, to newSize bytes. The latest
+// allocation grows in place while its block has room; otherwise the contents are copied to a
+// new allocation and the old one stays unused until the arena is released.
+void *arena_grow(Arena *arena, void *memory, size_t oldSize, size_t newSize);
+
+// Same as render_text for band, the rows from top on of a taller image: only the text rows
+// that fall into the band are drawn.
+void render_text_band(Image *band, int top, const GlyphAtlas *atlas, const char *message, int row, int col);
+
+// Returns count child arenas of arena for helper threads, one each, kept with their blocks
+// from one job to the next. Returns NULL if they could not be allocated.
+Arena *arena_children(Arena *arena, int count);
+
+#endif
@@ -1,424 +1,675 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "hw2.h"
 
 extern char *optarg;
 extern int optopt;
 
-#define MISSING_ARGUMENT 1
-#define UNRECOGNIZED_ARGUMENT 2
-#define DUPLICATE_ARGUMENT 3
-#define INPUT_FILE_MISSING 4
-#define OUTPUT_FILE_UNWRITABLE 5
-#define C_ARGUMENT_MISSING 6
-#define C_ARGUMENT_INVALID 7
-#define P_ARGUMENT_INVALID 8
-#define R_ARGUMENT_INVALID 9
+// Inputs larger than this stream through the library a band of rows at a time, edits included.
+// Can be overridden at compile time.
+#ifndef STREAM_THRESHOLD_BYTES
+#define STREAM_THRESHOLD_BYTES (256LL << 20)
+#endif
 
-typedef struct {
-    unsigned char r, g, b;
-} RGBPixel;
+bool file_exists(const char *path) {
+    return access(path, F_OK) == 0;
+}
 
-typedef struct {
-    int width, height;
-    RGBPixel *pixels;
-} Image;
+bool file_writable(const char *path) {
+    char tempFilePath[256];
+    snprintf(tempFilePath, sizeof(tempFilePath), "%s.tmp", path);
+    FILE *file = fopen(tempFilePath, "w");
+    if (file == NULL) return false;
+    fclose(file);
+    remove(tempFilePath);
+    return true;
+}
 
+// %n records how much of the argument was consumed, so trailing values such as a fifth
+// number after "-c 1,2,3,4" are rejected.
+bool parse_c_argument(const char *arg, Rect *region) {
+    int consumed = 0;
+    return sscanf(arg, "%d,%d,%d,%d%n", &region->row, &region->col, &region->width, &region->height, &consumed) == 4 &&
+           arg[consumed] == '\0' && region->row >= 0 && region->col >= 0 && region->width > 0 && region->height > 0;
+}
 
-bool load_ppm(const char *filename, Image *image) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Unable to open file");
-        return false;
-    }
-    
-    char magicNumber[3];
-    if (!fgets(magicNumber, sizeof(magicNumber), file) || strcmp(magicNumber, "P3\n") != 0) {
-        fprintf(stderr, "Invalid PPM file format.\n");
-        fclose(file);
-        return false;
-    }
+bool parse_p_argument(const char *arg, int *row, int *col) {
+    int consumed = 0;
+    return sscanf(arg, "%d,%d%n", row, col, &consumed) == 2 && arg[consumed] == '\0' && *row >= 0 && *col >= 0;
+}
 
-    if (fscanf(file, "%d %d", &image->width, &image->height) != 2) {
-        fprintf(stderr, "Failed to read image dimensions.\n");
-        fclose(file);
-        return false;
-    }
+bool validate_c_argument(const char *arg) {
+    Rect region;
+    return parse_c_argument(arg, &region);
+}
 
-    int maxColorValue;
-    if (fscanf(file, "%d", &maxColorValue) != 1 || maxColorValue != 255) {
-        fprintf(stderr, "Invalid or unsupported max color value.\n");
-        fclose(file);
-        return false;
-    }
+bool validate_p_argument(const char *arg) {
+    int row, col;
+    return parse_p_argument(arg, &row, &col);
+}
 
-    image->pixels = (RGBPixel*)malloc(image->width * image->height * sizeof(RGBPixel));
-    if (image->pixels == NULL) {
-        fprintf(stderr, "Memory allocation failed.\n");
-        fclose(file);
-        return false;
-    }
+typedef struct {
+    char message[256], fontPath[256];
+    int fontSize, row, col;
+} TextRequest;
 
-    for (int i = 0; i < image->width * image->height; i++) {
-        int r, g, b;
-        if (fscanf(file, "%d %d %d", &r, &g, &b) != 3) {
-            fprintf(stderr, "Error reading pixel data.\n");
-            free(image->pixels);
-            fclose(file);
-            return false;
-        }
-        image->pixels[i].r = (unsigned char)r;
-        image->pixels[i].g = (unsigned char)g;
-        image->pixels[i].b = (unsigned char)b;
-    }
+bool parse_r_argument(const char *arg, TextRequest *text) {
+    int consumed = 0;
+    memset(text, 0, sizeof(*text));
+    int result = sscanf(arg, "%255[^,],%255[^,],%d,%d,%d%n", text->message, text->fontPath, &text->fontSize, &text->row,
+                        &text->col, &consumed);
+
+    if (result != 5 || arg[consumed] != '\0') return false;
+    if (text->fontSize < 1 || text->fontSize > 10) return false;
+    if (text->row < 0 || text->col < 0) return false;
+    if (!file_exists(text->fontPath)) return false;
 
-    fclose(file);
     return true;
 }
 
+bool validate_r_argument(const char *arg) {
+    TextRequest text;
+    return parse_r_argument(arg, &text);
+}
 
-bool load_sbu(const char *filename, Image *image) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Unable to open file");
-        return false;
-    }
+typedef struct {
+    char *inputFile, *outputFile, *renderArg;
+    bool copy, paste, render, rawPpm, stream, stats;
+    Rect copyRegion;
+    int pasteRow, pasteCol;
+    TextRequest text;
+} Options;
+
+// True when arg is one of the options rather than a parameter.
+bool is_option_name(const char *arg) {
+    if (strcmp(arg, "--stats") == 0) return true;
+    return arg[0] == '-' && arg[1] != '\0' && strchr("iocprbs", arg[1]) != NULL && arg[2] == '\0';
+}
 
-    char header[4];
-    if (fscanf(file, "%3s", header) < 1 || strcmp(header, "SBU") != 0) {
-        fprintf(stderr, "Invalid SBU file format.\n");
-        fclose(file);
-        return false;
+// Parses the command line into options. A missing -i, -o or option parameter is reported
+// first; otherwise the first problem in argument order, and only then a missing input file or
+// an unwritable output file. -p needs a -c anywhere on the line, so it may come before it.
+int parse_arguments(int argc, char *argv[], Options *options) {
+    static const struct option longOptions[] = {{"stats", no_argument, NULL, 'S'}, {NULL, 0, NULL, 0}};
+    static const char *const shortOptions = ":i:o:c:p:r:bs";
+    bool i_flag = false, o_flag = false, c_flag = false, p_flag = false, r_flag = false, b_flag = false, s_flag = false;
+    bool stats_flag = false, c_given = false, missing = false;
+    int error = 0, opt;
+
+    memset(options, 0, sizeof(*options));
+    // Batch mode parses many command lines; optind = 0 makes glibc's getopt start over.
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        if (opt == 'c') c_given = true;
     }
 
-    if (fscanf(file, "%d %d", &image->width, &image->height) != 2) {
-        fprintf(stderr, "Failed to read image dimensions.\n");
-        fclose(file);
-        return false;
-    }
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        // An option directly followed by another option has no parameter of its own; give the
+        // second option back to getopt.
+        if (strchr("iocpr", opt) != NULL && is_option_name(optarg) && optarg == argv[optind - 1]) {
+            missing = true;
+            optind--;
+            continue;
+        }
 
-    int entries;
-    if (fscanf(file, "%d", &entries) != 1) {
-        fprintf(stderr, "Failed to read the number of color table entries.\n");
-        fclose(file);
-        return false;
+        int found = 0;
+        switch (opt) {
+            case 'i':
+                if (i_flag) found = DUPLICATE_ARGUMENT;
+                i_flag = true;
+                options->inputFile = optarg;
+                break;
+            case 'o':
+                if (o_flag) found = DUPLICATE_ARGUMENT;
+                o_flag = true;
+                options->outputFile = optarg;
+                break;
+            case 'c':
+                if (c_flag) found = DUPLICATE_ARGUMENT;
+                else if (!parse_c_argument(optarg, &options->copyRegion)) found = C_ARGUMENT_INVALID;
+                c_flag = true;
+                break;
+            case 'p':
+                if (!c_given) found = C_ARGUMENT_MISSING;
+                else if (p_flag) found = DUPLICATE_ARGUMENT;
+                else if (!parse_p_argument(optarg, &options->pasteRow, &options->pasteCol)) found = P_ARGUMENT_INVALID;
+                p_flag = true;
+                break;
+            case 'r':
+                if (r_flag) found = DUPLICATE_ARGUMENT;
+                else if (!parse_r_argument(optarg, &options->text)) found = R_ARGUMENT_INVALID;
+                r_flag = true;
+                options->renderArg = optarg;
+                break;
+            case 'b':
+                if (b_flag) found = DUPLICATE_ARGUMENT;
+                b_flag = true;
+                break;
+            case 's':
+                if (s_flag) found = DUPLICATE_ARGUMENT;
+                s_flag = true;
+                break;
+            case 'S':
+                if (stats_flag) found = DUPLICATE_ARGUMENT;
+                stats_flag = true;
+                break;
+            case ':':
+                missing = true;
+                break;
+            case '?':
+            default:
+                found = UNRECOGNIZED_ARGUMENT;
+                break;
+        }
+        if (error == 0) error = found;
     }
 
-    while (fgetc(file) != '\n');
-
-    RGBPixel *colorTable = malloc(entries * sizeof(RGBPixel));
-    if (!colorTable) {
-        fprintf(stderr, "Unable to allocate memory for color table.\n");
-        fclose(file);
-        return false;
-    }
+    options->copy = c_flag;
+    options->paste = p_flag;
+    options->render = r_flag;
+    options->rawPpm = b_flag;
+    options->stream = s_flag;
+    options->stats = stats_flag;
+
+    if (missing || !i_flag || !o_flag) return MISSING_ARGUMENT;
+    if (error != 0) return error;
+    if (!file_exists(options->inputFile)) return INPUT_FILE_MISSING;
+    if (!file_writable(options->outputFile)) return OUTPUT_FILE_UNWRITABLE;
+    return 0;
+}
 
-    for (int i = 0; i < entries; i++) {
-        if (fscanf(file, "%hhu %hhu %hhu", &colorTable[i].r, &colorTable[i].g, &colorTable[i].b) != 3) {
-            fprintf(stderr, "Failed to read color table entry %d.\n", i);
-            free(colorTable);
-            fclose(file);
-            return false;
-        }
-    }
+// Atlases already loaded by earlier jobs of this process, keyed by font path and scale.
+typedef struct {
+    char fontPath[256];
+    int scale;
+    GlyphAtlas atlas;
+} FontCacheEntry;
+
+// State shared by the jobs run in one process: the arena that holds a job's pixels, color
+// tables and palettes, kept with its blocks from one job to the next, the fonts loaded so far
+// and the threads a job may use (0 for one per online processor).
+typedef struct {
+    Image image;
+    Arena arena;
+    int threads;
+    FontCacheEntry *fonts;
+    size_t fontCount, fontCapacity;
+} JobContext;
+
+void free_job_context(JobContext *context) {
+    free_image(&context->image);
+    free_arena(&context->arena);
+    for (size_t i = 0; i < context->fontCount; i++) free_glyph_atlas(&context->fonts[i].atlas);
+    free(context->fonts);
+    memset(context, 0, sizeof(*context));
+}
 
-    image->pixels = malloc(image->width * image->height * sizeof(RGBPixel));
-    if (!image->pixels) {
-        fprintf(stderr, "Unable to allocate memory for pixels.\n");
-        free(colorTable);
-        fclose(file);
-        return false;
+const GlyphAtlas *get_glyph_atlas(JobContext *context, const char *fontPath, int scale) {
+    for (size_t i = 0; i < context->fontCount; i++) {
+        FontCacheEntry *entry = &context->fonts[i];
+        if (entry->scale == scale && strcmp(entry->fontPath, fontPath) == 0) return &entry->atlas;
     }
 
-    int pix = 0;
-    while (pix < image->width * image->height && !feof(file)) {
-        char ch = fgetc(file);
-        if (ch == '*') { 
-            int count, index;
-            fscanf(file, "%d %d", &count, &index);
-            for (int i = 0; i < count; i++, pix++) {
-                if (pix < image->width * image->height && index < entries) {
-                    image->pixels[pix] = colorTable[index];
-                }
-            }
-        } else if (ch >= '0' && ch <= '9') { 
-            ungetc(ch, file); 
-            int index;
-            fscanf(file, "%d", &index);
-            if (pix < image->width * image->height && index < entries) {
-                image->pixels[pix++] = colorTable[index];
-            }
+    if (context->fontCount == context->fontCapacity) {
+        size_t capacity = context->fontCapacity ? context->fontCapacity * 2 : 4;
+        FontCacheEntry *grown = realloc(context->fonts, capacity * sizeof(FontCacheEntry));
+        if (grown == NULL) {
+            fprintf(stderr, "Failed to allocate memory for the font cache.\n");
+            return NULL;
         }
+        context->fonts = grown;
+        context->fontCapacity = capacity;
     }
 
-    free(colorTable);
-    fclose(file);
-    return true;
-}
-bool compare_rgb_pixels(RGBPixel a, RGBPixel b) {
-    return a.r == b.r && a.g == b.g && a.b == b.b;
+    FontCacheEntry *entry = &context->fonts[context->fontCount];
+    if (load_glyph_atlas(fontPath, scale, &entry->atlas) != HW2_OK) {
+        fprintf(stderr, "%s\n", hw2_error_message());
+        return NULL;
+    }
+    snprintf(entry->fontPath, sizeof(entry->fontPath), "%s", fontPath);
+    entry->scale = scale;
+    context->fontCount++;
+    return &entry->atlas;
 }
 
-int calculate_color_palette(Image *image, RGBPixel **palette, int *paletteSize) {
-    RGBPixel *tempPalette = malloc(image->width * image->height * sizeof(RGBPixel));
-    *paletteSize = 0;
-
-    for (int i = 0; i < image->width * image->height; i++) {
-        bool found = false;
-        for (int j = 0; j < *paletteSize; j++) {
-            if (compare_rgb_pixels(image->pixels[i], tempPalette[j])) {
-                found = true;
-                break;
+int run_job(const Options *options, JobContext *context) {
+    // Large inputs (or any input with -s) stream through a band of rows instead of loading the
+    // whole image; copy/paste and text are made on each band as it passes.
+    struct stat inputStat;
+    if (options->stream || (stat(options->inputFile, &inputStat) == 0 && inputStat.st_size > STREAM_THRESHOLD_BYTES)) {
+        StreamEdits edits = {.copy = options->copy && options->paste, .source = options->copyRegion,
+                             .pasteRow = options->pasteRow, .pasteCol = options->pasteCol};
+        if (options->render) {
+            edits.atlas = get_glyph_atlas(context, options->text.fontPath, options->text.fontSize);
+            if (edits.atlas == NULL) {
+                fprintf(stderr, "Failed to load the font file.\n");
+                return 1;
             }
+            edits.message = options->text.message;
+            edits.textRow = options->text.row;
+            edits.textCol = options->text.col;
         }
-        if (!found) {
-            tempPalette[(*paletteSize)++] = image->pixels[i];
+        if (convert_streaming(options->inputFile, options->outputFile, options->rawPpm, &edits, &context->arena) !=
+            HW2_OK) {
+            fprintf(stderr, "%s\nFailed to convert the input file.\n", hw2_error_message());
+            return 1;
         }
+        return 0;
     }
 
-    *palette = malloc(*paletteSize * sizeof(RGBPixel));
-    memcpy(*palette, tempPalette, *paletteSize * sizeof(RGBPixel));
-    free(tempPalette);
-
-    return *paletteSize; 
-}
-
-
-
-int find_palette_index(RGBPixel *palette, int paletteSize, RGBPixel pixel) {
-    for (int i = 0; i < paletteSize; i++) {
-        if (compare_rgb_pixels(pixel, palette[i])) {
-            return i;
-        }
+    Image *image = &context->image;
+    if (load_image(options->inputFile, image, options->paste || options->render) != HW2_OK) {
+        fprintf(stderr, "%s\nFailed to load the input file.\n", hw2_error_message());
+        return 1;
     }
-    return -1; 
-}
 
-bool save_ppm(const char *filename, Image *image) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        perror("Unable to open file for writing");
-        return false;
+    if (options->copy && options->paste) {
+        blit_region(image, options->copyRegion, options->pasteRow, options->pasteCol);
     }
 
-    fprintf(file, "P3\n%d %d\n255\n", image->width, image->height);
-
-    for (int i = 0; i < image->width * image->height; i++) {
-        fprintf(file, "%d %d %d\t", image->pixels[i].r, image->pixels[i].g, image->pixels[i].b);
-        if ((i + 1) % image->width == 0) { 
-            fprintf(file, "\n");
+    if (options->render) {
+        const GlyphAtlas *atlas = get_glyph_atlas(context, options->text.fontPath, options->text.fontSize);
+        if (atlas == NULL) {
+            fprintf(stderr, "Failed to load the font file.\n");
+            return 1;
         }
+        render_text(image, atlas, options->text.message, options->text.row, options->text.col);
     }
 
-    fclose(file);
-    return true;
-
-}
-
-bool save_sbu(const char *filename, Image *image) {
-    FILE *file = fopen(filename, "wb"); 
-    if (!file) {
-        perror("Unable to open file for writing");
-        return false;
+    if (save_image(options->outputFile, image, options->rawPpm) != HW2_OK) {
+        fprintf(stderr, "%s\nFailed to save the output file.\n", hw2_error_message());
+        return 1;
     }
+    return 0;
+}
 
-    fprintf(file, "SBU");
-    fwrite(&image->width, sizeof(int), 1, file);
-    fwrite(&image->height, sizeof(int), 1, file);
-
-    int paletteSize = 0; 
-    RGBPixel *palette = NULL;
-    calculate_color_palette(image, &palette, &paletteSize); 
+// Runs one load -> edit -> save job. Returns 0 on success and 1 if the image could not be
+// loaded or saved. Whatever the job allocated is released at once when it ends.
+int process_image(const Options *options, JobContext *context) {
+    context->image.arena = &context->arena;
+    hw2_set_thread_budget(context->threads);
+    int error = run_job(options, context);
+    release_image(&context->image);
+    release_arena(&context->arena);
+    return error;
+}
 
-    fwrite(&paletteSize, sizeof(int), 1, file);
-    for (int i = 0; i < paletteSize; i++) {
-        fwrite(&palette[i], sizeof(RGBPixel), 1, file);
+void report_argument_error(int error) {
+    switch (error) {
+        case MISSING_ARGUMENT:
+            fprintf(stderr, "Error: Missing required arguments.\n");
+            break;
+        case INPUT_FILE_MISSING:
+            fprintf(stderr, "Error: Input file does not exist.\n");
+            break;
+        case OUTPUT_FILE_UNWRITABLE:
+            fprintf(stderr, "Error: Output file is not writable.\n");
+            break;
+        default:
+            fprintf(stderr, "Error: %d\n", error);
+            break;
     }
+}
 
-    for (int i = 0; i < image->width * image->height; i++) {
-        unsigned char index = find_palette_index(palette, paletteSize, image->pixels[i]);
-        fwrite(&index, sizeof(unsigned char), 1, file);
+#define BATCH_MAX_ARGS 64
+
+// Splits a job line into arguments in place. Arguments are separated by whitespace; single or
+// double quotes group text containing spaces and are removed, as the shell would do.
+int split_job_line(char *line, char *args[], int maxArgs) {
+    int count = 0;
+    char *in = line;
+    while (*in) {
+        while (isspace((unsigned char)*in)) in++;
+        if (*in == '\0') break;
+        if (count == maxArgs) return -1;
+
+        char *out = in;
+        args[count++] = out;
+        char quote = 0;
+        for (; *in && (quote || !isspace((unsigned char)*in)); in++) {
+            if (quote ? *in == quote : (*in == '"' || *in == '\'')) {
+                quote = quote ? 0 : *in;
+                continue;
+            }
+            *out++ = *in;
+        }
+        if (*in) in++;
+        *out = '\0';
     }
+    return count;
+}
 
-    fclose(file);
-    free(palette);
+// One line of a batch file. The parsed options point into line.
+typedef struct {
+    Options options;
+    char *line;
+    int lineNumber, error;
+    off_t size;
+    bool runnable;
+} BatchJob;
+
+// A worker's queue of job indices. The owner takes jobs from the head; idle workers steal
+// from the tail. Jobs are only added before the workers start, so a short critical section
+// under a per-deque mutex is all the synchronization needed.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t *jobs;
+    size_t head, tail;
+} JobDeque;
+
+// Runs batch jobs on a fixed set of workers. A job must hold one of the contexts (and with it
+// its arena) while it runs, so the number of contexts bounds how many images are in memory
+// at once.
+typedef struct {
+    BatchJob *jobs;
+    JobDeque *deques;
+    int workerCount;
+    JobContext *contexts;
+    JobContext **freeContexts;
+    int freeCount;
+    pthread_mutex_t contextLock;
+    pthread_cond_t contextReleased;
+} JobScheduler;
 
-    return true;
+typedef struct {
+    JobScheduler *scheduler;
+    int id;
+} JobWorker;
+
+bool deque_take(JobDeque *deque, bool fromHead, size_t *job) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->head < deque->tail;
+    if (found) *job = fromHead ? deque->jobs[deque->head++] : deque->jobs[--deque->tail];
+    pthread_mutex_unlock(&deque->lock);
+    return found;
 }
 
-bool file_exists(const char *path) {
-    return access(path, F_OK) == 0;
+// Takes the next job for a worker: its own largest remaining job, or else one stolen from
+// another worker, visiting the others round-robin from the next id. There is no more work once
+// every deque is empty, since jobs are never added while the workers run.
+bool scheduler_next_job(JobScheduler *scheduler, int id, size_t *job) {
+    if (deque_take(&scheduler->deques[id], true, job)) return true;
+    for (int i = 1; i < scheduler->workerCount; i++) {
+        if (deque_take(&scheduler->deques[(id + i) % scheduler->workerCount], false, job)) return true;
+    }
+    return false;
 }
 
-bool file_writable(const char *path) {
-    char tempFilePath[256];
-    snprintf(tempFilePath, sizeof(tempFilePath), "%s.tmp", path);
-    FILE *file = fopen(tempFilePath, "w");
-    if (file == NULL) return false;
-    fclose(file);
-    remove(tempFilePath);
-    return true;
+JobContext *scheduler_acquire_context(JobScheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->contextLock);
+    while (scheduler->freeCount == 0) pthread_cond_wait(&scheduler->contextReleased, &scheduler->contextLock);
+    JobContext *context = scheduler->freeContexts[--scheduler->freeCount];
+    pthread_mutex_unlock(&scheduler->contextLock);
+    return context;
 }
 
-bool validate_c_argument(const char *arg) {
-    int row, col, width, height;
-    return sscanf(arg, "%d,%d,%d,%d", &row, &col, &width, &height) == 4 &&
-           row >= 0 && col >= 0 && width > 0 && height > 0;
+void scheduler_release_context(JobScheduler *scheduler, JobContext *context) {
+    pthread_mutex_lock(&scheduler->contextLock);
+    scheduler->freeContexts[scheduler->freeCount++] = context;
+    pthread_cond_signal(&scheduler->contextReleased);
+    pthread_mutex_unlock(&scheduler->contextLock);
 }
 
-bool validate_p_argument(const char *arg) {
-    int row, col;
-    return sscanf(arg, "%d,%d", &row, &col) == 2 &&
-           row >= 0 && col >= 0;
+void *job_worker_main(void *arg) {
+    JobWorker *worker = arg;
+    JobScheduler *scheduler = worker->scheduler;
+    size_t job;
+    while (scheduler_next_job(scheduler, worker->id, &job)) {
+        const Options *options = &scheduler->jobs[job].options;
+        JobContext *context = scheduler_acquire_context(scheduler);
+        Hw2Stats stats;
+        if (options->stats) hw2_stats_start(&stats);
+        scheduler->jobs[job].error = process_image(options, context);
+        if (options->stats) {
+            hw2_stats_stop();
+            hw2_stats_print(&stats, stderr);
+        }
+        scheduler_release_context(scheduler, context);
+    }
+    return NULL;
 }
 
-bool validate_r_argument(const char *arg) {
-    char message[256] = {0}, fontPath[256] = {0};
-    int fontSize, row, col;
-    int result = sscanf(arg, "%255[^,],%255[^,],%d,%d,%d", message, fontPath, &fontSize, &row, &col);
-
-    if (result != 5) return false;
-    if (fontSize < 1 || fontSize > 10) return false;
-    if (row < 0 || col < 0) return false;
-    if (!file_exists(fontPath)) return false;
-
-    return true;
+// Largest input first, then file order.
+int compare_jobs_by_size(const void *a, const void *b) {
+    const BatchJob *jobA = *(const BatchJob *const *)a;
+    const BatchJob *jobB = *(const BatchJob *const *)b;
+    if (jobA->size != jobB->size) return jobA->size > jobB->size ? -1 : 1;
+    return jobA->lineNumber - jobB->lineNumber;
 }
 
-int main(int argc, char *argv[]) {
-    bool i_flag = false, o_flag = false, c_flag = false, p_flag = false, r_flag = false;
-    char *input_file = NULL, *output_file = NULL;
-    int opt, error = 0;
+// Runs the runnable jobs on workerCount threads with at most inFlight images loaded at once.
+// Jobs are sorted largest-first and dealt round-robin, so every worker starts on one of the
+// biggest inputs and the small jobs at the end fill in around stragglers.
+bool run_jobs(BatchJob *jobs, size_t jobCount, int workerCount, int inFlight) {
+    JobScheduler scheduler = {0};
+    BatchJob **order = malloc((jobCount + 1) * sizeof(BatchJob *));
+    size_t *slots = malloc((jobCount + 1) * sizeof(size_t));
+    JobWorker *workers = malloc((size_t)workerCount * sizeof(JobWorker));
+    pthread_t *threads = malloc((size_t)workerCount * sizeof(pthread_t));
+    scheduler.deques = calloc((size_t)workerCount, sizeof(JobDeque));
+    scheduler.contexts = calloc((size_t)inFlight, sizeof(JobContext));
+    scheduler.freeContexts = malloc((size_t)inFlight * sizeof(JobContext *));
+    bool ok = order && slots && workers && threads && scheduler.deques && scheduler.contexts && scheduler.freeContexts;
+    if (!ok) {
+        fprintf(stderr, "Failed to allocate memory for the batch.\n");
+    } else {
+        size_t runnable = 0;
+        for (size_t i = 0; i < jobCount; i++) {
+            if (jobs[i].runnable) order[runnable++] = &jobs[i];
+        }
+        qsort(order, runnable, sizeof(BatchJob *), compare_jobs_by_size);
+
+        // Worker w owns slots[w * perWorker ...] and receives jobs w, w + workerCount, ...
+        size_t perWorker = (runnable + (size_t)workerCount - 1) / (size_t)workerCount;
+        for (int w = 0; w < workerCount; w++) {
+            JobDeque *deque = &scheduler.deques[w];
+            pthread_mutex_init(&deque->lock, NULL);
+            deque->jobs = slots + (size_t)w * perWorker;
+            for (size_t i = (size_t)w; i < runnable; i += (size_t)workerCount) {
+                deque->jobs[deque->tail++] = (size_t)(order[i] - jobs);
+            }
+        }
 
-    while ((opt = getopt(argc, argv, ":i:o:c:p:r:")) != -1) {
-        switch (opt) {
-            case 'i':
-                if (i_flag) error = DUPLICATE_ARGUMENT;
-                else {
-                    i_flag = true;
-                    input_file = optarg;
-                }
-                break;
-            case 'o':
-                if (o_flag) error = DUPLICATE_ARGUMENT;
-                else {
-                    o_flag = true;
-                    output_file = optarg;
-                }
-                break;
-            case 'c':
-                if (c_flag) error = DUPLICATE_ARGUMENT;
-                else {
-                    c_flag = true;
-                    if (!validate_c_argument(optarg)) error = C_ARGUMENT_INVALID;
-                }
-                break;
-            case 'p':
-                if (!c_flag) error = C_ARGUMENT_MISSING;
-                else if (p_flag) error = DUPLICATE_ARGUMENT;
-                else if (!validate_p_argument(optarg)) error = P_ARGUMENT_INVALID;
-                else p_flag = true;
-                break;
-            case 'r':
-                if (!c_flag) error = C_ARGUMENT_MISSING;
-                else if (r_flag) error = DUPLICATE_ARGUMENT;
-                else if (!validate_r_argument(optarg)) error = R_ARGUMENT_INVALID;
-                else r_flag = true;
-                break;
-            case ':':
-                if (optopt == 'i' || optopt == 'o' || optopt == 'c' || optopt == 'p' || optopt == 'r') {
-                    error = MISSING_ARGUMENT;
-                }
-                break;
-            case '?':
-            default:
-                error = UNRECOGNIZED_ARGUMENT;
-                break;
+        scheduler.jobs = jobs;
+        scheduler.workerCount = workerCount;
+        // The workers share the processors, so a job splits its loading and encoding over its
+        // worker's share of them only.
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        int jobThreads = processors > workerCount ? (int)(processors / workerCount) : 1;
+        for (int i = 0; i < inFlight; i++) {
+            scheduler.contexts[i].threads = jobThreads;
+            scheduler.freeContexts[i] = &scheduler.contexts[i];
+        }
+        scheduler.freeCount = inFlight;
+        pthread_mutex_init(&scheduler.contextLock, NULL);
+        pthread_cond_init(&scheduler.contextReleased, NULL);
+
+        int started = 0;
+        for (; started < workerCount; started++) {
+            workers[started] = (JobWorker){&scheduler, started};
+            if (pthread_create(&threads[started], NULL, job_worker_main, &workers[started]) != 0) break;
         }
-        if (error) break;
+        // Whatever could not be started is picked up by stealing; with no thread at all the
+        // jobs run here.
+        if (started == 0) job_worker_main(&workers[0]);
+        for (int w = 0; w < started; w++) pthread_join(threads[w], NULL);
+
+        pthread_cond_destroy(&scheduler.contextReleased);
+        pthread_mutex_destroy(&scheduler.contextLock);
+        for (int w = 0; w < workerCount; w++) pthread_mutex_destroy(&scheduler.deques[w].lock);
+        for (int i = 0; i < inFlight; i++) free_job_context(&scheduler.contexts[i]);
     }
 
-
-if (!i_flag || !o_flag) {
-    fprintf(stderr, "Error: Missing required arguments.\n");
-    return MISSING_ARGUMENT;
+    free(order);
+    free(slots);
+    free(workers);
+    free(threads);
+    free(scheduler.deques);
+    free(scheduler.contexts);
+    free(scheduler.freeContexts);
+    return ok;
 }
 
-if (!error && input_file && !file_exists(input_file)) {
-    fprintf(stderr, "Error: Input file does not exist.\n");
-    return INPUT_FILE_MISSING;
-}
+// Runs every job of a batch file in this process. Each non-empty line not starting with '#'
+// holds the arguments of one hw2_main run and is validated exactly like a command line. All
+// lines are validated before any job starts and the jobs then run concurrently, so they must
+// be independent of each other (no job may read another's output). Workers keep their arenas
+// and loaded fonts from job to job. One line per job, "<line> <error code>", is printed
+// to stdout in file order; the exit code is that of the first job that failed, or 0. Jobs given
+// --stats print their statistics to stderr as they finish, without the argument stage.
+int run_batch(const char *jobFile, int workerCount, int inFlight) {
+    FILE *file = fopen(jobFile, "r");
+    if (file == NULL) {
+        perror("Unable to open the batch file");
+        return MISSING_ARGUMENT;
+    }
 
-if (!error && output_file && !file_writable(output_file)) {
-    fprintf(stderr, "Error: Output file is not writable.\n");
-    return OUTPUT_FILE_UNWRITABLE;
-}
+    BatchJob *jobs = NULL;
+    size_t jobCount = 0, jobCapacity = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    int lineNumber = 0, firstError = 0;
+    bool ok = true;
+    while (ok && getline(&line, &capacity, file) != -1) {
+        lineNumber++;
+        char *args[BATCH_MAX_ARGS + 1];
+        args[0] = "hw2_main";
+        char *text = strdup(line);
+        if (text == NULL) {
+            ok = false;
+            break;
+        }
+        int count = split_job_line(text, args + 1, BATCH_MAX_ARGS - 1);
+        if (count == 0 || (count > 0 && args[1][0] == '#')) {
+            free(text);
+            continue;
+        }
 
-if (error) {
-    fprintf(stderr, "Error: %d\n", error);
-    return error;
-}
+        if (jobCount == jobCapacity) {
+            jobCapacity = jobCapacity ? jobCapacity * 2 : 16;
+            BatchJob *grown = realloc(jobs, jobCapacity * sizeof(BatchJob));
+            if (grown == NULL) {
+                free(text);
+                ok = false;
+                break;
+            }
+            jobs = grown;
+        }
 
-if (i_flag) {
-    char *extension = strrchr(input_file, '.');
-    if (extension != NULL) {
-        Image image = {0}; 
-        bool load_success = false; 
-        
-        if (strcmp(extension, ".ppm") == 0) {
-            load_success = load_ppm(input_file, &image);
-        } else if (strcmp(extension, ".sbu") == 0) {
-            load_success = load_sbu(input_file, &image);
-        } else {
-            fprintf(stderr, "Unsupported file format.\n");
+        BatchJob *job = &jobs[jobCount++];
+        memset(job, 0, sizeof(*job));
+        job->line = text;
+        job->lineNumber = lineNumber;
+        job->error = UNRECOGNIZED_ARGUMENT;
+        if (count > 0) {
+            args[count + 1] = NULL;
+            job->error = parse_arguments(count + 1, args, &job->options);
         }
-        
-        if (!load_success) {
-            return 1; 
+        if (job->error != 0) {
+            fprintf(stderr, "%s:%d: ", jobFile, lineNumber);
+            report_argument_error(job->error);
+            continue;
         }
 
-        free(image.pixels); 
+        struct stat inputStat;
+        job->size = stat(job->options.inputFile, &inputStat) == 0 ? inputStat.st_size : 0;
+        job->runnable = true;
+    }
+    free(line);
+    fclose(file);
+
+    if (!ok || !run_jobs(jobs, jobCount, workerCount, inFlight)) {
+        fprintf(stderr, "Failed to run the batch.\n");
+        firstError = 1;
     } else {
-        fprintf(stderr, "Invalid file path.\n");
-        return 1; 
+        for (size_t i = 0; i < jobCount; i++) {
+            printf("%d %d\n", jobs[i].lineNumber, jobs[i].error);
+            if (firstError == 0) firstError = jobs[i].error;
+        }
     }
+
+    for (size_t i = 0; i < jobCount; i++) free(jobs[i].line);
+    free(jobs);
+    return firstError;
 }
 
-    Image image;
-    bool load_success = false, save_success = false;
+// Reads a positive count for a batch option such as --threads.
+bool parse_count(const char *arg, int *count) {
+    int consumed = 0;
+    return arg != NULL && sscanf(arg, "%d%n", count, &consumed) == 1 && arg[consumed] == '\0' && *count > 0;
+}
 
-    char *in_extension = strrchr(input_file, '.');
-    if (strcmp(in_extension, ".ppm") == 0) {
-        load_success = load_ppm(input_file, &image);
-    } else if (strcmp(in_extension, ".sbu") == 0) {
-        load_success = load_sbu(input_file, &image);
-    } else {
-        fprintf(stderr, "Unsupported input file format.\n");
+// hw2_main --batch jobfile [--threads N] [--in-flight N]. Both counts default to the number of
+// online processors.
+int parse_batch_arguments(int argc, char *argv[], const char **jobFile, int *workerCount, int *inFlight) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    bool threadsSet = false, inFlightSet = false;
+    *jobFile = NULL;
+    *workerCount = processors > 0 ? (int)processors : 1;
+    *inFlight = -1;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "--in-flight") == 0) {
+            bool threads = argv[i][2] == 't';
+            if (threads ? threadsSet : inFlightSet) return DUPLICATE_ARGUMENT;
+            if (i + 1 == argc) return MISSING_ARGUMENT;
+            if (!parse_count(argv[++i], threads ? workerCount : inFlight)) return UNRECOGNIZED_ARGUMENT;
+            if (threads) {
+                threadsSet = true;
+            } else {
+                inFlightSet = true;
+            }
+        } else if (*jobFile == NULL && argv[i][0] != '-') {
+            *jobFile = argv[i];
+        } else {
+            return UNRECOGNIZED_ARGUMENT;
+        }
     }
+    if (*jobFile == NULL) return MISSING_ARGUMENT;
+    if (*inFlight < 0) *inFlight = *workerCount;
+    return 0;
+}
 
-    if (!load_success) {
-        fprintf(stderr, "Failed to load the input file.\n");
-        return 1;
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        const char *jobFile;
+        int workerCount, inFlight;
+        int error = parse_batch_arguments(argc, argv, &jobFile, &workerCount, &inFlight);
+        if (error != 0) {
+            report_argument_error(error);
+            return error;
+        }
+        return run_batch(jobFile, workerCount, inFlight);
     }
 
-    char *out_extension = strrchr(output_file, '.');
-    if (strcmp(out_extension, ".ppm") == 0) {
-        save_success = save_ppm(output_file, &image);
-    } else if (strcmp(out_extension, ".sbu") == 0) {
-        save_success = save_sbu(output_file, &image);
-    } else {
-        fprintf(stderr, "Unsupported output file format.\n");
+    // Argument validation is timed before it is known whether --stats was given; without it the
+    // statistics are dropped.
+    Hw2Stats stats;
+    hw2_stats_start(&stats);
+    hw2_stats_stage(HW2_STAGE_ARGUMENTS);
+    Options options;
+    int error = parse_arguments(argc, argv, &options);
+    hw2_stats_stage(HW2_STAGE_NONE);
+    if (error != 0 || !options.stats) hw2_stats_stop();
+    if (error != 0) {
+        report_argument_error(error);
+        return error;
     }
 
-    if (!save_success) {
-        fprintf(stderr, "Failed to save the output file.\n");
-        free(image.pixels); 
-        return 1;
+    JobContext context = {0};
+    error = process_image(&options, &context);
+    free_job_context(&context);
+    if (options.stats) {
+        hw2_stats_stop();
+        hw2_stats_print(&stats, stderr);
     }
-
-    free(image.pixels);
-return 0; 
-
-}
\ No newline at end of file
+    return error;
+}
@@ -0,0 +1,401 @@
+#include <string.h>
+#include <stdbool.h>
+#include "hw2_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HW2_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define HW2_SIMD_X86 0
+#endif
+
+// Scalar kernels. These define the results every vector version must reproduce and also
+// handle the tails the vector loops leave over.
+
+static inline bool is_space(unsigned char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+static size_t pixels_mismatch_scalar(const unsigned char *a, const unsigned char *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (a[i * 3] != b[i * 3] || a[i * 3 + 1] != b[i * 3 + 1] || a[i * 3 + 2] != b[i * 3 + 2]) return i;
+    }
+    return count;
+}
+
+static size_t run_length_scalar(const unsigned char *pixels, size_t count) {
+    if (count == 0) return 0;
+    return 1 + pixels_mismatch_scalar(pixels, pixels + 3, count - 1);
+}
+
+static void pack_pixels_scalar(const unsigned char *pixels, uint32_t *keys, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = ((uint32_t)pixels[i * 3] << 16) | ((uint32_t)pixels[i * 3 + 1] << 8) | pixels[i * 3 + 2];
+    }
+}
+
+static void fill_pixels_scalar(unsigned char *out, size_t count, unsigned char r, unsigned char g, unsigned char b) {
+    if (r == g && g == b) {
+        memset(out, r, count * 3);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i * 3] = r;
+        out[i * 3 + 1] = g;
+        out[i * 3 + 2] = b;
+    }
+}
+
+// Stores a decoded value into a byte or a 32-bit output array.
+static inline void store_value(void *out, bool wide, size_t index, uint32_t value) {
+    if (wide) {
+        ((uint32_t *)out)[index] = value;
+    } else {
+        ((unsigned char *)out)[index] = (unsigned char)value;
+    }
+}
+
+// Decodes from *pos onward, bounds-checked against len. Values have at most 3 digits for byte
+// output and 9 for wide output, so they never overflow.
+static size_t decode_tail(const unsigned char *text, size_t len, size_t *pos, void *out, bool wide, size_t count,
+                          uint32_t maxValue) {
+    size_t maxDigits = wide ? 9 : 3;
+    size_t p = *pos, done = 0;
+    while (done < count) {
+        while (p < len && is_space(text[p])) p++;
+        if (p == len) break;
+
+        size_t start = p;
+        uint32_t value = 0;
+        while (p < len && p - start <= maxDigits && (unsigned)text[p] - '0' <= 9) {
+            value = value * 10 + (unsigned)text[p++] - '0';
+        }
+        if (p == start || p - start > maxDigits || (p < len && !is_space(text[p])) || value > maxValue) {
+            p = start;
+            break;
+        }
+        store_value(out, wide, done++, value);
+    }
+    *pos = p;
+    return done;
+}
+
+static size_t decode_bytes_scalar(const unsigned char *text, size_t len, unsigned char *out, size_t count,
+                                  unsigned maxValue, size_t *consumed) {
+    *consumed = 0;
+    return decode_tail(text, len, consumed, out, false, count, maxValue);
+}
+
+static size_t decode_uints_scalar(const unsigned char *text, size_t len, uint32_t *out, size_t count,
+                                  uint32_t maxValue, size_t *consumed) {
+    *consumed = 0;
+    return decode_tail(text, len, consumed, out, true, count, maxValue);
+}
+
+// Shared by the vector decoders: decodes the values that lie entirely inside the window of
+// width bytes at text + p, given the window's digit and whitespace bit masks. Returns false
+// when decoding must stop (count reached or malformed input) with *next set to the stop
+// position; otherwise *next is where the following window starts, which is the start of a
+// value cut off by the window end.
+static inline bool decode_window(const unsigned char *text, size_t p, uint32_t digits, uint32_t spaces, int width,
+                                 void *out, bool wide, size_t *done, size_t count, uint32_t maxValue, size_t *next) {
+    int maxDigits = wide ? 9 : 3;
+    uint32_t full = (uint32_t)((1ull << width) - 1);
+    uint32_t bad = ~(digits | spaces) & full;
+    uint32_t starts = digits;
+    while (starts) {
+        int s = __builtin_ctz(starts);
+        if (bad && __builtin_ctz(bad) < s) break;
+        // digits >> s has zeros shifted in at the top, so the complement always has a set bit.
+        int e = s + __builtin_ctz(~(digits >> s));
+        if (e == width) {
+            *next = p + (size_t)s;
+            return s > 0;
+        }
+        if (e - s > maxDigits || !(spaces >> e & 1)) {
+            *next = p + (size_t)s;
+            return false;
+        }
+        const unsigned char *digit = text + p + s;
+        uint32_t value = 0;
+        for (int k = 0; k < e - s; k++) value = value * 10 + (uint32_t)(digit[k] - '0');
+        if (value > maxValue) {
+            *next = p + (size_t)s;
+            return false;
+        }
+        store_value(out, wide, (*done)++, value);
+        if (*done == count) {
+            *next = p + (size_t)e;
+            return false;
+        }
+        starts = digits & (uint32_t)((uint64_t)full << (e + 1));
+    }
+    if (bad) {
+        *next = p + (size_t)__builtin_ctz(bad);
+        return false;
+    }
+    *next = p + (size_t)width;
+    return true;
+}
+
+#if HW2_SIMD_X86
+
+// SSE2 is part of x86-64, so these need no target attribute there.
+// Compares 16 pixels (three vectors) at a time against the first pixel's color repeated.
+__attribute__((target("sse2")))
+static size_t run_length_sse2(const unsigned char *pixels, size_t count) {
+    if (count == 0) return 0;
+    unsigned char pattern[48];
+    for (int i = 0; i < 48; i++) pattern[i] = pixels[i % 3];
+    __m128i p0 = _mm_loadu_si128((const __m128i *)pattern);
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(pattern + 16));
+    __m128i p2 = _mm_loadu_si128((const __m128i *)(pattern + 32));
+
+    size_t i = 1;
+    for (; i + 16 <= count; i += 16) {
+        const unsigned char *block = pixels + i * 3;
+        uint64_t equal = (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)block), p0)) |
+                         (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(block + 16)), p1)) << 16 |
+                         (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(block + 32)), p2)) << 32;
+        uint64_t differ = ~equal & 0xffffffffffffull;
+        if (differ) return i + (size_t)__builtin_ctzll(differ) / 3;
+    }
+    // Pixel i - 1 still has the run's color, so the rest is a run starting there.
+    return i - 1 + run_length_scalar(pixels + (i - 1) * 3, count - i + 1);
+}
+
+__attribute__((target("sse2")))
+static void fill_pixels_sse2(unsigned char *out, size_t count, unsigned char r, unsigned char g, unsigned char b) {
+    if (r == g && g == b) {
+        memset(out, r, count * 3);
+        return;
+    }
+    unsigned char pattern[48];
+    for (int i = 0; i < 48; i += 3) {
+        pattern[i] = r;
+        pattern[i + 1] = g;
+        pattern[i + 2] = b;
+    }
+    __m128i p0 = _mm_loadu_si128((const __m128i *)pattern);
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(pattern + 16));
+    __m128i p2 = _mm_loadu_si128((const __m128i *)(pattern + 32));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm_storeu_si128((__m128i *)(out + i * 3), p0);
+        _mm_storeu_si128((__m128i *)(out + i * 3 + 16), p1);
+        _mm_storeu_si128((__m128i *)(out + i * 3 + 32), p2);
+    }
+    fill_pixels_scalar(out + i * 3, count - i, r, g, b);
+}
+
+__attribute__((target("sse2")))
+static inline size_t decode_sse2(const unsigned char *text, size_t len, void *out, bool wide, size_t count,
+                                 uint32_t maxValue, size_t *consumed) {
+    const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9);
+    const __m128i tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4), blank = _mm_set1_epi8(' ');
+    size_t p = 0, done = 0;
+    while (done < count && len - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(text + p));
+        // Unsigned x <= n is max(x, n) == n.
+        __m128i value = _mm_sub_epi8(block, zero);
+        __m128i control = _mm_sub_epi8(block, tab);
+        uint32_t digits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(value, nine), nine));
+        uint32_t spaces = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, blank),
+                                                                   _mm_cmpeq_epi8(_mm_max_epu8(control, four), four)));
+        if (!decode_window(text, p, digits, spaces, 16, out, wide, &done, count, maxValue, &p)) {
+            *consumed = p;
+            return done;
+        }
+    }
+    done += decode_tail(text, len, &p, wide ? (void *)((uint32_t *)out + done) : (void *)((unsigned char *)out + done),
+                        wide, count - done, maxValue);
+    *consumed = p;
+    return done;
+}
+
+__attribute__((target("sse2")))
+static size_t decode_bytes_sse2(const unsigned char *text, size_t len, unsigned char *out, size_t count,
+                                unsigned maxValue, size_t *consumed) {
+    return decode_sse2(text, len, out, false, count, maxValue, consumed);
+}
+
+__attribute__((target("sse2")))
+static size_t decode_uints_sse2(const unsigned char *text, size_t len, uint32_t *out, size_t count,
+                                uint32_t maxValue, size_t *consumed) {
+    return decode_sse2(text, len, out, true, count, maxValue, consumed);
+}
+
+// Compares 32 pixels (three vectors) at a time against the first pixel's color repeated.
+__attribute__((target("avx2")))
+static size_t run_length_avx2(const unsigned char *pixels, size_t count) {
+    if (count == 0) return 0;
+    unsigned char pattern[96];
+    for (int i = 0; i < 96; i++) pattern[i] = pixels[i % 3];
+    __m256i p0 = _mm256_loadu_si256((const __m256i *)pattern);
+    __m256i p1 = _mm256_loadu_si256((const __m256i *)(pattern + 32));
+    __m256i p2 = _mm256_loadu_si256((const __m256i *)(pattern + 64));
+
+    size_t i = 1;
+    for (; i + 32 <= count; i += 32) {
+        const unsigned char *block = pixels + i * 3;
+        uint32_t m0 = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)block), p0));
+        uint32_t m1 = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(block + 32)), p1));
+        uint32_t m2 = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(block + 64)), p2));
+        if (m0) return i + (size_t)__builtin_ctz(m0) / 3;
+        if (m1) return i + (size_t)(32 + __builtin_ctz(m1)) / 3;
+        if (m2) return i + (size_t)(64 + __builtin_ctz(m2)) / 3;
+    }
+    return i - 1 + run_length_sse2(pixels + (i - 1) * 3, count - i + 1);
+}
+
+// Packs 8 pixels at a time: each 128-bit lane gets 12 bytes (4 pixels), which one byte shuffle
+// spreads into 4 little-endian 32-bit keys. Each pair of loads reads 28 bytes, so at least 10
+// pixels must remain.
+__attribute__((target("avx2")))
+static void pack_pixels_avx2(const unsigned char *pixels, uint32_t *keys, size_t count) {
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                             2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    size_t i = 0;
+    for (; i + 10 <= count; i += 8) {
+        __m128i low = _mm_loadu_si128((const __m128i *)(pixels + i * 3));
+        __m128i high = _mm_loadu_si128((const __m128i *)(pixels + i * 3 + 12));
+        __m256i both = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        _mm256_storeu_si256((__m256i *)(keys + i), _mm256_shuffle_epi8(both, shuffle));
+    }
+    pack_pixels_scalar(pixels + i * 3, keys + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void fill_pixels_avx2(unsigned char *out, size_t count, unsigned char r, unsigned char g, unsigned char b) {
+    if (r == g && g == b) {
+        memset(out, r, count * 3);
+        return;
+    }
+    unsigned char pattern[96];
+    for (int i = 0; i < 96; i += 3) {
+        pattern[i] = r;
+        pattern[i + 1] = g;
+        pattern[i + 2] = b;
+    }
+    __m256i p0 = _mm256_loadu_si256((const __m256i *)pattern);
+    __m256i p1 = _mm256_loadu_si256((const __m256i *)(pattern + 32));
+    __m256i p2 = _mm256_loadu_si256((const __m256i *)(pattern + 64));
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        _mm256_storeu_si256((__m256i *)(out + i * 3), p0);
+        _mm256_storeu_si256((__m256i *)(out + i * 3 + 32), p1);
+        _mm256_storeu_si256((__m256i *)(out + i * 3 + 64), p2);
+    }
+    fill_pixels_scalar(out + i * 3, count - i, r, g, b);
+}
+
+__attribute__((target("avx2")))
+static inline size_t decode_avx2(const unsigned char *text, size_t len, void *out, bool wide, size_t count,
+                                 uint32_t maxValue, size_t *consumed) {
+    const __m256i zero = _mm256_set1_epi8('0'), nine = _mm256_set1_epi8(9);
+    const __m256i tab = _mm256_set1_epi8('\t'), four = _mm256_set1_epi8(4), blank = _mm256_set1_epi8(' ');
+    size_t p = 0, done = 0;
+    while (done < count && len - p >= 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(text + p));
+        __m256i value = _mm256_sub_epi8(block, zero);
+        __m256i control = _mm256_sub_epi8(block, tab);
+        uint32_t digits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(value, nine), nine));
+        uint32_t spaces = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, blank), _mm256_cmpeq_epi8(_mm256_max_epu8(control, four), four)));
+        if (!decode_window(text, p, digits, spaces, 32, out, wide, &done, count, maxValue, &p)) {
+            *consumed = p;
+            return done;
+        }
+    }
+    done += decode_tail(text, len, &p, wide ? (void *)((uint32_t *)out + done) : (void *)((unsigned char *)out + done),
+                        wide, count - done, maxValue);
+    *consumed = p;
+    return done;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_bytes_avx2(const unsigned char *text, size_t len, unsigned char *out, size_t count,
+                                unsigned maxValue, size_t *consumed) {
+    return decode_avx2(text, len, out, false, count, maxValue, consumed);
+}
+
+__attribute__((target("avx2")))
+static size_t decode_uints_avx2(const unsigned char *text, size_t len, uint32_t *out, size_t count,
+                                uint32_t maxValue, size_t *consumed) {
+    return decode_avx2(text, len, out, true, count, maxValue, consumed);
+}
+
+#endif
+
+typedef struct {
+    size_t (*run_length)(const unsigned char *pixels, size_t count);
+    void (*pack_pixels)(const unsigned char *pixels, uint32_t *keys, size_t count);
+    void (*fill_pixels)(unsigned char *out, size_t count, unsigned char r, unsigned char g, unsigned char b);
+    size_t (*decode_bytes)(const unsigned char *text, size_t len, unsigned char *out, size_t count, unsigned maxValue,
+                           size_t *consumed);
+    size_t (*decode_uints)(const unsigned char *text, size_t len, uint32_t *out, size_t count, uint32_t maxValue,
+                           size_t *consumed);
+} SimdKernels;
+
+static const SimdKernels scalarKernels = {run_length_scalar, pack_pixels_scalar, fill_pixels_scalar,
+                                          decode_bytes_scalar, decode_uints_scalar};
+#if HW2_SIMD_X86
+// There is no SSE2 byte shuffle, so SSE2 packing stays scalar.
+static const SimdKernels sse2Kernels = {run_length_sse2, pack_pixels_scalar, fill_pixels_sse2, decode_bytes_sse2,
+                                        decode_uints_sse2};
+static const SimdKernels avx2Kernels = {run_length_avx2, pack_pixels_avx2, fill_pixels_avx2, decode_bytes_avx2,
+                                        decode_uints_avx2};
+#endif
+
+static const SimdKernels *kernels = &scalarKernels;
+static int kernelLevel = HW2_SIMD_SCALAR;
+
+int hw2_simd_level(void) {
+    return kernelLevel;
+}
+
+int hw2_simd_set_level(int level) {
+    kernels = &scalarKernels;
+    kernelLevel = HW2_SIMD_SCALAR;
+#if HW2_SIMD_X86
+    __builtin_cpu_init();
+    if (level >= HW2_SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+        kernels = &avx2Kernels;
+        kernelLevel = HW2_SIMD_AVX2;
+    } else if (level >= HW2_SIMD_SSE2 && __builtin_cpu_supports("sse2")) {
+        kernels = &sse2Kernels;
+        kernelLevel = HW2_SIMD_SSE2;
+    }
+#else
+    (void)level;
+#endif
+    return kernelLevel;
+}
+
+// Picks the best kernels before main runs, so the dispatch pointer is never written while
+// worker threads read it.
+__attribute__((constructor)) static void hw2_simd_init(void) {
+    hw2_simd_set_level(HW2_SIMD_AVX2);
+}
+
+size_t hw2_run_length(const unsigned char *pixels, size_t count) {
+    return kernels->run_length(pixels, count);
+}
+
+void hw2_pack_pixels(const unsigned char *pixels, uint32_t *keys, size_t count) {
+    kernels->pack_pixels(pixels, keys, count);
+}
+
+void hw2_fill_pixels(unsigned char *out, size_t count, unsigned char r, unsigned char g, unsigned char b) {
+    kernels->fill_pixels(out, count, r, g, b);
+}
+
+size_t hw2_decode_bytes(const unsigned char *text, size_t len, unsigned char *out, size_t count, unsigned maxValue,
+                        size_t *consumed) {
+    return kernels->decode_bytes(text, len, out, count, maxValue, consumed);
+}
+
+size_t hw2_decode_uints(const unsigned char *text, size_t len, uint32_t *out, size_t count, uint32_t maxValue,
+                        size_t *consumed) {
+    return kernels->decode_uints(text, len, out, count, maxValue, consumed);
+}
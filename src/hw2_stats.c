@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <time.h>
+#include "hw2.h"
+#include "hw2_internal.h"
+
+_Thread_local Hw2Stats *hw2ActiveStats = NULL;
+
+static const char *const stageNames[HW2_STAGE_COUNT] = {"arguments", "load",   "copy_paste", "render",
+                                                        "palette",   "encode", "write"};
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+double hw2_thread_cpu_seconds(void) {
+    return clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void hw2_stats_sample_heap(void) {
+    Hw2Stats *stats = hw2ActiveStats;
+    if (stats == NULL) return;
+    // Small blocks come from the arenas, large ones (such as pixel arrays) are mapped separately.
+    struct mallinfo2 info = mallinfo2();
+    size_t heap = info.uordblks + info.hblkhd;
+    if (heap > stats->peakHeapBytes) stats->peakHeapBytes = heap;
+}
+
+void hw2_stats_add_cpu(double seconds) {
+    Hw2Stats *stats = hw2ActiveStats;
+    if (stats != NULL && stats->stage != HW2_STAGE_NONE) stats->cpuSeconds[stats->stage] += seconds;
+}
+
+// Charges the time since the last stage change to the current stage.
+static void stats_charge(Hw2Stats *stats) {
+    double wall = clock_seconds(CLOCK_MONOTONIC), cpu = hw2_thread_cpu_seconds();
+    if (stats->stage != HW2_STAGE_NONE) {
+        stats->wallSeconds[stats->stage] += wall - stats->stageWall;
+        stats->cpuSeconds[stats->stage] += cpu - stats->stageCpu;
+    }
+    stats->stageWall = wall;
+    stats->stageCpu = cpu;
+    hw2_stats_sample_heap();
+}
+
+void hw2_stats_start(Hw2Stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->stage = HW2_STAGE_NONE;
+    hw2ActiveStats = stats;
+    stats_charge(stats);
+}
+
+int hw2_stats_stage(int stage) {
+    Hw2Stats *stats = hw2ActiveStats;
+    if (stats == NULL) return HW2_STAGE_NONE;
+    int previous = stats->stage;
+    if (stage != previous) {
+        stats_charge(stats);
+        stats->stage = stage;
+    }
+    return previous;
+}
+
+void hw2_stats_stop(void) {
+    Hw2Stats *stats = hw2ActiveStats;
+    if (stats == NULL) return;
+    stats_charge(stats);
+    stats->stage = HW2_STAGE_NONE;
+    hw2ActiveStats = NULL;
+}
+
+void hw2_stats_print(const Hw2Stats *stats, FILE *file) {
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "{\"stages\":{");
+    for (int i = 0; i < HW2_STAGE_COUNT; i++) {
+        len += snprintf(line + len, sizeof(line) - (size_t)len, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f}",
+                        i > 0 ? "," : "", stageNames[i], stats->wallSeconds[i], stats->cpuSeconds[i]);
+    }
+    snprintf(line + len, sizeof(line) - (size_t)len,
+             "},\"bytes_read\":%llu,\"bytes_written\":%llu,\"pixels\":%llu,\"palette_size\":%d,\"rle_runs\":%llu,"
+             "\"peak_heap_bytes\":%zu}",
+             (unsigned long long)stats->bytesRead, (unsigned long long)stats->bytesWritten,
+             (unsigned long long)stats->pixels, stats->paletteSize, (unsigned long long)stats->rleRuns,
+             stats->peakHeapBytes);
+    // One call, so lines printed by concurrent batch jobs do not interleave.
+    fprintf(file, "%s\n", line);
+}
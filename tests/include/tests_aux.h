@@ -7,8 +7,26 @@
 
 #define INFO(MSG) do{std::cerr << "[          ] [ INFO ] " << (MSG) << std::endl;}while(0)
 
+// The build under test; CMake passes the paths of its own targets so that any build directory
+// can run the tests.
+#ifndef HW2_MAIN
+#define HW2_MAIN "./build/hw2_main"
+#endif
+#ifndef IO_COUNTER_LIB
+#define IO_COUNTER_LIB "./build/libio_counter.so"
+#endif
+
 bool file_exists(const char *path);
 void expect_no_valgrind_errors(int status);
 void check_image_file_contents(const char *expected_file, const char *actual_file);
 int run_using_system(const char *args);
 int run_using_valgrind(const char *args);
+
+// Every test writes into its own directory, ./tests/actual_outputs/<suite>.<test>, so the suites
+// can run in parallel under ctest -j. prepare_output_dir recreates it empty; call it from SetUp.
+void prepare_output_dir();
+// Path of name inside the current test's output directory. Stays valid until the next
+// prepare_output_dir.
+const char *actual_output(const char *name);
+// Returns text with every "$OUT" replaced by the current test's output directory.
+std::string with_output_dir(const char *text);
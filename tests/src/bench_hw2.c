@@ -0,0 +1,273 @@
+// In-process benchmark for the hot paths of hw2_main: loading and saving PPM and SBU, palette
+// construction, copy/paste and text rendering. Every routine runs on a synthetic image of the
+// requested size and color count and on each PPM image of the corpus directory. Each result is
+// printed as one JSON object per line:
+//
+//   {"image":"synthetic","op":"load_sbu","width":1024,"height":1024,"bytes":...,"seconds":...,
+//    "mpixels_per_s":...,"mb_per_s":...,"allocs":...,"alloc_bytes":...}
+//
+// seconds is the best of the repetitions; allocs and alloc_bytes count the malloc, calloc and
+// realloc calls made by the image code during one repetition (see the --wrap link options).
+//
+// Usage: ./build/hw2_bench [--size WIDTHxHEIGHT] [--colors N] [--repeat N] [--corpus DIR] [--font FILE]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "hw2.h"
+
+static size_t allocCount, allocBytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocBytes, size, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocBytes, count * size, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocBytes, size, __ATOMIC_RELAXED);
+    return __real_realloc(pointer, size);
+}
+
+typedef struct {
+    int repetitions;
+    char scratch[PATH_MAX];
+    const char *fontPath;
+} BenchConfig;
+
+typedef enum {
+    BENCH_SAVE_PPM,
+    BENCH_LOAD_PPM,
+    BENCH_SAVE_SBU,
+    BENCH_LOAD_SBU,
+    BENCH_PALETTE,
+    BENCH_COPY_PASTE,
+    BENCH_RENDER,
+    BENCH_OP_COUNT
+} BenchOp;
+
+static const char *const benchOpNames[BENCH_OP_COUNT] = {"save_ppm", "load_ppm",   "save_sbu",   "load_sbu",
+                                                         "palette",  "copy_paste", "render_text"};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static size_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+// Runs one repetition of op on image. Loads go into scratch so the source image stays intact.
+// Sets *bytes to the size of the file read or written, or 0 when the op touches no file.
+static bool run_op(BenchOp op, const BenchConfig *config, Image *image, Image *scratch, const GlyphAtlas *atlas,
+                   size_t *bytes) {
+    char ppmPath[PATH_MAX + 16], sbuPath[PATH_MAX + 16];
+    snprintf(ppmPath, sizeof(ppmPath), "%s/bench.ppm", config->scratch);
+    snprintf(sbuPath, sizeof(sbuPath), "%s/bench.sbu", config->scratch);
+    *bytes = 0;
+    bool ok = true;
+    switch (op) {
+    case BENCH_SAVE_PPM:
+        ok = save_ppm(ppmPath, image) == HW2_OK;
+        *bytes = file_size(ppmPath);
+        break;
+    case BENCH_LOAD_PPM:
+        ok = load_ppm(ppmPath, scratch, false) == HW2_OK;
+        release_image(scratch);
+        *bytes = file_size(ppmPath);
+        break;
+    case BENCH_SAVE_SBU:
+        ok = save_sbu(sbuPath, image) == HW2_OK;
+        *bytes = file_size(sbuPath);
+        break;
+    case BENCH_LOAD_SBU:
+        ok = load_sbu(sbuPath, scratch) == HW2_OK;
+        release_image(scratch);
+        *bytes = file_size(sbuPath);
+        break;
+    case BENCH_PALETTE: {
+        RGBPixel *palette;
+        int paletteSize;
+        ok = calculate_color_palette(image, &palette, &paletteSize) >= 0;
+        if (ok) free(palette);
+        break;
+    }
+    case BENCH_COPY_PASTE: {
+        Rect region = {0, 0, image->width / 2, image->height / 2};
+        blit_region(image, region, image->height / 2, image->width / 2);
+        break;
+    }
+    case BENCH_RENDER:
+        // Fill the image with lines of text, as many as fit.
+        for (int row = 0; row < image->height; row += atlas->rows * atlas->scale + 1) {
+            render_text(image, atlas, "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG", row, 0);
+        }
+        break;
+    case BENCH_OP_COUNT:
+        break;
+    }
+    return ok;
+}
+
+// Times every op on image in order (each load reads the file its save just wrote) and prints
+// one result line per op.
+static bool bench_image(const char *name, Image *image, const BenchConfig *config, const GlyphAtlas *atlas) {
+    Image scratch = {0};
+    double pixels = (double)image->width * image->height;
+    bool ok = true;
+    for (int op = 0; ok && op < BENCH_OP_COUNT; op++) {
+        double best = 1e30;
+        size_t bytes = 0, allocs = 0, allocated = 0;
+        for (int i = 0; ok && i < config->repetitions; i++) {
+            size_t countBefore = __atomic_load_n(&allocCount, __ATOMIC_RELAXED);
+            size_t bytesBefore = __atomic_load_n(&allocBytes, __ATOMIC_RELAXED);
+            double start = now_seconds();
+            ok = run_op((BenchOp)op, config, image, &scratch, atlas, &bytes);
+            double seconds = now_seconds() - start;
+            if (seconds < best) best = seconds;
+            allocs = __atomic_load_n(&allocCount, __ATOMIC_RELAXED) - countBefore;
+            allocated = __atomic_load_n(&allocBytes, __ATOMIC_RELAXED) - bytesBefore;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s failed on %s: %s\n", benchOpNames[op], name, hw2_error_message());
+            break;
+        }
+        printf("{\"image\":\"%s\",\"op\":\"%s\",\"width\":%d,\"height\":%d,\"bytes\":%zu,\"seconds\":%.6f,"
+               "\"mpixels_per_s\":%.2f,\"mb_per_s\":%.2f,\"allocs\":%zu,\"alloc_bytes\":%zu}\n",
+               name, benchOpNames[op], image->width, image->height, bytes, best, pixels / best * 1e-6,
+               (double)bytes / best * 1e-6, allocs, allocated);
+        fflush(stdout);
+    }
+    free_image(&scratch);
+    return ok;
+}
+
+// Same generator as bench_sbu_encode: colors are drawn at random from a set of the given size
+// and spread over all three channels.
+static bool make_synthetic(Image *image, int width, int height, int colors) {
+    if (allocate_image(image, width, height) != HW2_OK) return false;
+    unsigned state = 12345;
+    for (size_t i = 0; i < (size_t)width * (size_t)height; i++) {
+        state = state * 1103515245u + 12345u;
+        unsigned color = (state >> 8) % (unsigned)colors;
+        image->pixels[i] = (RGBPixel){(unsigned char)(color * 7), (unsigned char)(color >> 8), (unsigned char)color};
+    }
+    return true;
+}
+
+static bool bench_corpus(const char *directory, const BenchConfig *config, const GlyphAtlas *atlas) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        perror(directory);
+        return false;
+    }
+    bool ok = true;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        const char *extension = strrchr(entry->d_name, '.');
+        if (!extension || strcmp(extension, ".ppm") != 0) continue;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        Image image = {0};
+        // Raw PPM files come back as a private writable mapping, which copy/paste and render may modify.
+        ok = load_ppm(path, &image, true) == HW2_OK && bench_image(entry->d_name, &image, config, atlas);
+        free_image(&image);
+    }
+    closedir(dir);
+    return ok;
+}
+
+static bool parse_positive(const char *arg, int *value) {
+    char *end;
+    long parsed = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || parsed < 1 || parsed > INT_MAX) return false;
+    *value = (int)parsed;
+    return true;
+}
+
+// Removes the scratch directory with the files the ops and the glyph cache left in it.
+static void remove_scratch(const BenchConfig *config) {
+    DIR *dir = opendir(config->scratch);
+    if (dir) {
+        char path[PATH_MAX + 256];
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            snprintf(path, sizeof(path), "%s/%s", config->scratch, entry->d_name);
+            unlink(path);
+        }
+        closedir(dir);
+    }
+    rmdir(config->scratch);
+}
+
+int main(int argc, char *argv[]) {
+    int width = 1024, height = 1024, colors = 4096;
+    const char *corpus = "./tests/images";
+    BenchConfig config = {.repetitions = 3, .fontPath = "./tests/fonts/font1.txt"};
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--size") == 0 && hasValue && sscanf(argv[i + 1], "%dx%d", &width, &height) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--colors") == 0 && hasValue && parse_positive(argv[i + 1], &colors)) {
+            i++;
+        } else if (strcmp(argv[i], "--repeat") == 0 && hasValue && parse_positive(argv[i + 1], &config.repetitions)) {
+            i++;
+        } else if (strcmp(argv[i], "--corpus") == 0 && hasValue) {
+            corpus = argv[++i];
+        } else if (strcmp(argv[i], "--font") == 0 && hasValue) {
+            config.fontPath = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--size WIDTHxHEIGHT] [--colors N] [--repeat N] [--corpus DIR] [--font FILE]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid image size.\n");
+        return 1;
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    snprintf(config.scratch, sizeof(config.scratch), "%s/hw2_bench.XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(config.scratch)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    // Keep the glyph cache out of the user's cache directory.
+    setenv("HW2_FONT_CACHE_DIR", config.scratch, 1);
+
+    GlyphAtlas atlas;
+    Image image = {0};
+    bool ok = load_glyph_atlas(config.fontPath, 2, &atlas) == HW2_OK;
+    if (!ok) fprintf(stderr, "%s\n", hw2_error_message());
+    if (ok) {
+        ok = make_synthetic(&image, width, height, colors);
+        if (!ok) fprintf(stderr, "%s\n", hw2_error_message());
+        ok = ok && bench_image("synthetic", &image, &config, &atlas);
+        free_image(&image);
+        ok = ok && bench_corpus(corpus, &config, &atlas);
+        free_glyph_atlas(&atlas);
+    }
+    remove_scratch(&config);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// Benchmark for the SBU encoder. Generates synthetic PPM images of a fixed size with a growing
+// number of distinct colors and times the PPM -> SBU conversion through hw2_main.
+// With constant-time pixel -> palette index lookups the time should stay roughly flat as the
+// palette grows from 16 to 65536 colors.
+//
+// Usage: ./build/bench_sbu_encode [width height repetitions]
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+
+// CMake passes the hw2_main of the same build.
+#ifndef HW2_MAIN
+#define HW2_MAIN "./build/hw2_main"
+#endif
+
+static void write_synthetic_ppm(const char *path, int width, int height, int colors) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(file, "P3\n%d %d\n255\n", width, height);
+    unsigned state = 12345;
+    for (int row = 0; row < height; row++) {
+        for (int col = 0; col < width; col++) {
+            state = state * 1103515245u + 12345u;
+            unsigned color = (state >> 8) % (unsigned)colors;
+            // Spread the color number over all three channels so every value is a distinct RGB triple.
+            unsigned r = (color * 7) & 0xff, g = (color >> 8) & 0xff, b = color & 0xff;
+            fprintf(file, "%u %u %u ", r, g, b);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
+
+static double time_conversion(const char *input, const char *output, int repetitions) {
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), HW2_MAIN " -i %s -o %s", input, output);
+    double best = 1e30;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        int status = system(cmd);
+        auto stop = std::chrono::steady_clock::now();
+        if (status != 0) {
+            fprintf(stderr, "hw2_main failed: %s\n", cmd);
+            exit(1);
+        }
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        if (seconds < best) best = seconds;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    int width = 1024, height = 1024, repetitions = 3;
+    if (argc == 4) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+        repetitions = atoi(argv[3]);
+    }
+
+    mkdir("./tests/actual_outputs/", 0700);
+    const int palettes[] = {16, 256, 4096, 65536};
+    double baseline = 0;
+    printf("%10s %12s %12s %10s\n", "colors", "ppm->ppm s", "ppm->sbu s", "vs 16");
+    for (int colors : palettes) {
+        std::string input = "./tests/actual_outputs/bench_" + std::to_string(colors) + ".ppm";
+        write_synthetic_ppm(input.c_str(), width, height, colors);
+        // The PPM -> PPM time covers loading and writing; the difference to PPM -> SBU is the
+        // palette build plus index encoding.
+        double copy = time_conversion(input.c_str(), "./tests/actual_outputs/bench_out.ppm", repetitions);
+        double encode = time_conversion(input.c_str(), "./tests/actual_outputs/bench_out.sbu", repetitions);
+        if (colors == palettes[0]) baseline = encode;
+        printf("%10d %12.3f %12.3f %9.2fx\n", colors, copy, encode, encode / baseline);
+        remove(input.c_str());
+    }
+    return 0;
+}
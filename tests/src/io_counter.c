@@ -0,0 +1,151 @@
+// LD_PRELOAD shim used by tests_io_counts.cpp. Counts how many times the file named by
+// IO_COUNTER_PATH is opened and how many bytes are read from it, through read(), fread() or a
+// mapping, and writes "<opens> <bytes>" to IO_COUNTER_OUT when the traced process exits.
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+static int traced_fd_opens = 0;
+static int traced_file_opens = 0;
+static long traced_bytes = 0;
+static FILE *traced_files[16];
+static int traced_fds[16];
+
+static int is_traced(const char *path) {
+    const char *target = getenv("IO_COUNTER_PATH");
+    return target != NULL && path != NULL && strcmp(path, target) == 0;
+}
+
+static void remember_file(FILE *file) {
+    for (int i = 0; i < 16; i++) {
+        if (traced_files[i] == NULL) {
+            traced_files[i] = file;
+            return;
+        }
+    }
+}
+
+static void remember_fd(int fd) {
+    for (int i = 0; i < 16; i++) {
+        if (traced_fds[i] == 0) {
+            traced_fds[i] = fd + 1;
+            return;
+        }
+    }
+}
+
+static int file_is_traced(FILE *file) {
+    for (int i = 0; i < 16; i++) {
+        if (traced_files[i] == file) return 1;
+    }
+    return 0;
+}
+
+static int fd_is_traced(int fd) {
+    for (int i = 0; i < 16; i++) {
+        if (traced_fds[i] == fd + 1) return 1;
+    }
+    return 0;
+}
+
+FILE *fopen(const char *path, const char *mode) {
+    FILE *(*real_fopen)(const char *, const char *) = (FILE *(*)(const char *, const char *))dlsym(RTLD_NEXT, "fopen");
+    FILE *file = real_fopen(path, mode);
+    if (file != NULL && is_traced(path)) {
+        traced_file_opens++;
+        remember_file(file);
+    }
+    return file;
+}
+
+FILE *fopen64(const char *path, const char *mode) {
+    return fopen(path, mode);
+}
+
+int fclose(FILE *file) {
+    int (*real_fclose)(FILE *) = (int (*)(FILE *))dlsym(RTLD_NEXT, "fclose");
+    for (int i = 0; i < 16; i++) {
+        if (traced_files[i] == file) traced_files[i] = NULL;
+    }
+    return real_fclose(file);
+}
+
+size_t fread(void *ptr, size_t size, size_t count, FILE *file) {
+    size_t (*real_fread)(void *, size_t, size_t, FILE *) = (size_t (*)(void *, size_t, size_t, FILE *))dlsym(RTLD_NEXT, "fread");
+    size_t got = real_fread(ptr, size, count, file);
+    if (file_is_traced(file)) traced_bytes += (long)(got * size);
+    return got;
+}
+
+int open(const char *path, int flags, ...) {
+    int (*real_open)(const char *, int, ...) = (int (*)(const char *, int, ...))dlsym(RTLD_NEXT, "open");
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    int fd = real_open(path, flags, mode);
+    if (fd >= 0 && is_traced(path)) {
+        traced_fd_opens++;
+        remember_fd(fd);
+    }
+    return fd;
+}
+
+int open64(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    return open(path, flags, mode);
+}
+
+int close(int fd) {
+    int (*real_close)(int) = (int (*)(int))dlsym(RTLD_NEXT, "close");
+    for (int i = 0; i < 16; i++) {
+        if (traced_fds[i] == fd + 1) traced_fds[i] = 0;
+    }
+    return real_close(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    ssize_t (*real_read)(int, void *, size_t) = (ssize_t (*)(int, void *, size_t))dlsym(RTLD_NEXT, "read");
+    ssize_t got = real_read(fd, buf, count);
+    if (got > 0 && fd_is_traced(fd)) traced_bytes += got;
+    return got;
+}
+
+// A mapped file counts as read in full, whether or not its pages are touched.
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    void *(*real_mmap)(void *, size_t, int, int, int, off_t) =
+        (void *(*)(void *, size_t, int, int, int, off_t))dlsym(RTLD_NEXT, "mmap");
+    void *mapping = real_mmap(addr, length, prot, flags, fd, offset);
+    if (mapping != MAP_FAILED && !(flags & MAP_ANONYMOUS) && fd_is_traced(fd)) traced_bytes += (long)length;
+    return mapping;
+}
+
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    return mmap(addr, length, prot, flags, fd, offset);
+}
+
+__attribute__((destructor)) static void report_counts(void) {
+    const char *out = getenv("IO_COUNTER_OUT");
+    if (out == NULL) return;
+    FILE *(*real_fopen)(const char *, const char *) = (FILE *(*)(const char *, const char *))dlsym(RTLD_NEXT, "fopen");
+    FILE *file = real_fopen(out, "w");
+    if (file == NULL) return;
+    fprintf(file, "%d %ld\n", traced_file_opens + traced_fd_opens, traced_bytes);
+    fclose(file);
+}
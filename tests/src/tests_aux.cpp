@@ -1,7 +1,13 @@
+#include <string.h>
+#include <sys/stat.h>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <vector>
 #include "tests_aux.h"
 
-char cmd[300];
-char pargs[300];
+char cmd[1024];
+char pargs[1024];
 
 bool file_exists(const char *path) {
     return (access(path, F_OK) == 0);
@@ -12,33 +18,147 @@ void expect_no_valgrind_errors(int status) {
 }
 
 int run_using_valgrind(const char *args) {
-    sprintf(cmd, "valgrind --quiet -s --leak-check=full --show-leak-kinds=all --track-origins=yes --trace-children=yes --error-exitcode=37 ./build/hw2_main %s", args);
+    sprintf(cmd, "valgrind --quiet -s --leak-check=full --show-leak-kinds=all --track-origins=yes --trace-children=yes --error-exitcode=37 " HW2_MAIN " %s", args);
 	return system(cmd);
 }
 
 int run_using_system(const char *args) {
-    assert(file_exists("./build/hw2_main"));
-    (void)sprintf(cmd, "./build/hw2_main %s", args);
+    assert(file_exists(HW2_MAIN));
+    (void)sprintf(cmd, HW2_MAIN " %s", args);
 	return system(cmd);
 }
 
-void check_image_file_contents(const char *expected_file, const char *actual_file) {
-    assert(file_exists(expected_file));
-    if (file_exists(actual_file)) {
-        system("/usr/bin/bash -c \"rm -f /tmp/exp.txt /tmp/exp_single_line.txt /tmp/act.txt /tmp/act_single_line.txt\"");
-        sprintf(cmd, "cp %s /tmp/exp.txt; cp %s /tmp/act.txt", expected_file, actual_file);
-        system(cmd);
-        system("/usr/bin/bash -c \"chmod 700 ./tests/src/cleanup.sh; ./tests/src/cleanup.sh\"");
-        sprintf(cmd, "/usr/bin/bash -c \"diff -q /tmp/exp_single_line.txt /tmp/act_single_line.txt\"");
-        int status = system(cmd);
-        if (WEXITSTATUS(status) != 0) {
-            INFO("Expected image and actual image differ. Insert a breakpoint and review the files named");
-            INFO("/tmp/exp_single_line.txt and /tmp/act_single_line.txt");
+static std::string outputDir;
+static std::deque<std::string> outputPaths;
+
+void prepare_output_dir() {
+    const testing::TestInfo *test = testing::UnitTest::GetInstance()->current_test_info();
+    std::string name = std::string(test->test_suite_name()) + "." + test->name();
+    for (char &ch : name) {
+        if (ch == '/') ch = '_';
+    }
+    outputDir = "./tests/actual_outputs/" + name;
+    outputPaths.clear();
+    mkdir("./tests/actual_outputs", 0700);
+    std::string remove = "rm -rf " + outputDir;
+    system(remove.c_str());
+    mkdir(outputDir.c_str(), 0700);
+}
+
+const char *actual_output(const char *name) {
+    outputPaths.push_back(outputDir + "/" + name);
+    return outputPaths.back().c_str();
+}
+
+std::string with_output_dir(const char *text) {
+    std::string result = text;
+    for (size_t at = result.find("$OUT"); at != std::string::npos; at = result.find("$OUT", at + outputDir.size())) {
+        result.replace(at, 4, outputDir);
+    }
+    return result;
+}
+
+// Image file decoded to packed RGB triples, whatever its format.
+struct DecodedImage {
+    int width = 0, height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+static bool read_value(std::istream &in, int &value, int maxValue) {
+    return static_cast<bool>(in >> value) && value >= 0 && value <= maxValue;
+}
+
+// Decodes P3, P6 and SBU files independently of hw2_main, so that the check does not rely on
+// the loaders it is testing. Returns an empty string on success, else what was wrong.
+static std::string decode_image_file(const char *path, DecodedImage &image) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return "cannot open file";
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string text = contents.str();
+    std::istringstream in(text);
+
+    std::string magic;
+    in >> magic;
+    if (magic != "P3" && magic != "P6" && magic != "SBU") return "unknown format '" + magic + "'";
+    if (!(in >> image.width >> image.height) || image.width <= 0 || image.height <= 0) return "bad dimensions";
+    size_t count = (size_t)image.width * (size_t)image.height;
+    image.pixels.assign(count * 3, 0);
+
+    if (magic == "P3" || magic == "P6") {
+        int maxValue;
+        if (!read_value(in, maxValue, 65535) || maxValue != 255) return "bad max color value";
+        if (magic == "P6") {
+            size_t start = (size_t)in.tellg() + 1;
+            if (text.size() < start + count * 3) return "pixel data ends early";
+            memcpy(image.pixels.data(), text.data() + start, count * 3);
+            return "";
         }
-        EXPECT_EQ(0, WEXITSTATUS(status)); 
+        for (size_t i = 0; i < count * 3; i++) {
+            int value;
+            if (!read_value(in, value, 255)) return "bad pixel value at pixel " + std::to_string(i / 3);
+            image.pixels[i] = (unsigned char)value;
+        }
+        return "";
+    }
+
+    int entries;
+    if (!read_value(in, entries, 1 << 24)) return "bad color table size";
+    std::vector<unsigned char> table((size_t)entries * 3);
+    for (size_t i = 0; i < table.size(); i++) {
+        int value;
+        if (!read_value(in, value, 255)) return "bad color table entry " + std::to_string(i / 3);
+        table[i] = (unsigned char)value;
+    }
+    size_t done = 0;
+    std::string token;
+    while (done < count && in >> token) {
+        int run = 1, index;
+        if (token[0] == '*') {
+            std::string length = token.size() > 1 ? token.substr(1) : "";
+            if (length.empty() && !(in >> length)) return "run ends early";
+            run = atoi(length.c_str());
+            if (!read_value(in, index, entries - 1)) return "bad run color index at pixel " + std::to_string(done);
+        } else {
+            index = atoi(token.c_str());
+            if (token.find_first_not_of("0123456789") != std::string::npos || index >= entries) {
+                return "bad color index at pixel " + std::to_string(done);
+            }
+        }
+        if (run < 1 || done + (size_t)run > count) return "bad run length at pixel " + std::to_string(done);
+        for (int k = 0; k < run; k++, done++) memcpy(&image.pixels[done * 3], &table[(size_t)index * 3], 3);
     }
-    else {
+    return done == count ? "" : "pixel data ends early";
+}
+
+static std::string describe_pixel(const DecodedImage &image, size_t index) {
+    const unsigned char *p = &image.pixels[index * 3];
+    return "(" + std::to_string(p[0]) + ", " + std::to_string(p[1]) + ", " + std::to_string(p[2]) + ")";
+}
+
+// Compares the images the two files hold, ignoring how they are laid out as text: any
+// whitespace, P3 or P6, and for SBU the palette order and run encoding.
+void check_image_file_contents(const char *expected_file, const char *actual_file) {
+    assert(file_exists(expected_file));
+    if (!file_exists(actual_file)) {
         INFO("Output file does not exist.");
         FAIL();
     }
-}
\ No newline at end of file
+
+    DecodedImage expected, actual;
+    std::string error = decode_image_file(expected_file, expected);
+    ASSERT_EQ("", error) << "while reading " << expected_file;
+    error = decode_image_file(actual_file, actual);
+    ASSERT_EQ("", error) << "while reading " << actual_file;
+    ASSERT_EQ(expected.width, actual.width) << actual_file << " has the wrong width";
+    ASSERT_EQ(expected.height, actual.height) << actual_file << " has the wrong height";
+
+    size_t count = (size_t)expected.width * (size_t)expected.height, differing = 0, first = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (memcmp(&expected.pixels[i * 3], &actual.pixels[i * 3], 3) != 0 && differing++ == 0) first = i;
+    }
+    EXPECT_EQ(0u, differing) << differing << " of " << count << " pixels differ between " << expected_file << " and "
+                             << actual_file << "; the first at row " << first / (size_t)expected.width << ", column "
+                             << first % (size_t)expected.width << " is " << describe_pixel(actual, first)
+                             << ", expected " << describe_pixel(expected, first);
+}
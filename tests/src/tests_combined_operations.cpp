@@ -10,21 +10,19 @@ using namespace std;
 
 class image_operations_TestSuite : public testing::Test { 
 	void SetUp() override {
-        system("rm -rf ./tests/actual_outputs");
-        system("rm -f /tmp/exp_single_line.txt and /tmp/act_single_line.txt");
-		mkdir("./tests/actual_outputs/", 0700);
+		prepare_output_dir();
 	}
 };
 
-extern char cmd[300];
+extern char cmd[1024];
 
 // Copy & paste operations plus text rendering
 // Copied region does not overlap the text.
 TEST_F(image_operations_TestSuite, combined1) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/combined1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -c 125,130,150,40 -p 85,130 -i %s -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font1.txt\",2,50,5", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -c 125,130,150,40 -p 85,130 -i %s -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font1.txt\",2,50,5", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -35,8 +33,8 @@ TEST_F(image_operations_TestSuite, combined1) {
 TEST_F(image_operations_TestSuite, combined2) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/combined2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -c 125,130,150,40 -i %s -p 85,130 -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font4.txt\",2,100,10", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -c 125,130,150,40 -i %s -p 85,130 -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font4.txt\",2,100,10", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -48,10 +46,62 @@ TEST_F(image_operations_TestSuite, combined2) {
 TEST_F(image_operations_TestSuite, combined3) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/combined3.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -c 125,130,150,40 -p 85,130 -i %s -o %s -r \"NEw york state\",\"./tests/fonts/font3.txt\",5,50,5", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -c 125,130,150,40 -p 85,130 -i %s -o %s -r \"NEw york state\",\"./tests/fonts/font3.txt\",5,50,5", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
     check_image_file_contents(expected_output_file, actual_output_file);
 }
+
+// Copy & paste plus overlapping text made band by band while streaming with -s
+TEST_F(image_operations_TestSuite, combined_stream) {
+    const char *input_file = "./tests/images/stony.sbu";
+    const char *expected_output_file = "./tests/expected_outputs/combined2.ppm";
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -s -c 125,130,150,40 -i %s -p 85,130 -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font4.txt\",2,100,10", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Run several jobs, including a failing one, in one process with --batch
+TEST_F(image_operations_TestSuite, batch_jobs) {
+    FILE *jobs = fopen(actual_output("jobs.txt"), "w");
+    ASSERT_NE(nullptr, jobs);
+    fprintf(jobs, "# combined1, then a job with an invalid -c, then combined2\n");
+    fputs(with_output_dir("-c 125,130,150,40 -p 85,130 -i ./tests/images/stony.sbu -o $OUT/result1.ppm -r \"Go STONY BROOK\",\"./tests/fonts/font1.txt\",2,50,5\n").c_str(), jobs);
+    fputs(with_output_dir("-c 125,130 -p 85,130 -i ./tests/images/stony.sbu -o $OUT/result2.ppm\n").c_str(), jobs);
+    fputs(with_output_dir("-c 125,130,150,40 -i ./tests/images/stony.sbu -p 85,130 -o $OUT/result3.ppm -r \"Go STONY BROOK\",\"./tests/fonts/font4.txt\",2,100,10\n").c_str(), jobs);
+    fclose(jobs);
+    sprintf(cmd, HW2_MAIN " --batch %s > %s", actual_output("jobs.txt"), actual_output("jobs.out"));
+    INFO(cmd);
+    int status = system(cmd);
+    EXPECT_EQ(C_ARGUMENT_INVALID, WEXITSTATUS(status));
+    check_image_file_contents("./tests/expected_outputs/combined1.ppm", actual_output("result1.ppm"));
+    check_image_file_contents("./tests/expected_outputs/combined2.ppm", actual_output("result3.ppm"));
+    sprintf(cmd, "printf '2 0\\n3 7\\n4 0\\n' | cmp -s - %s", actual_output("jobs.out"));
+    EXPECT_EQ(0, WEXITSTATUS(system(cmd)));
+}
+
+// Run a batch on several threads with fewer images in flight than threads
+TEST_F(image_operations_TestSuite, batch_jobs_threads) {
+    FILE *jobs = fopen(actual_output("jobs.txt"), "w");
+    ASSERT_NE(nullptr, jobs);
+    for (int i = 0; i < 4; i++) {
+        string combined = "combined1_" + to_string(i) + ".ppm", desert = "desert_" + to_string(i) + ".sbu";
+        fprintf(jobs, "-c 125,130,150,40 -p 85,130 -i ./tests/images/stony.sbu -o %s -r \"Go STONY BROOK\",\"./tests/fonts/font1.txt\",2,50,5\n", actual_output(combined.c_str()));
+        fprintf(jobs, "-i ./tests/images/desert.ppm -o %s\n", actual_output(desert.c_str()));
+    }
+    fclose(jobs);
+    sprintf(cmd, HW2_MAIN " --batch %s --threads 4 --in-flight 2 > /dev/null", actual_output("jobs.txt"));
+    INFO(cmd);
+    int status = system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    for (int i = 0; i < 4; i++) {
+        string combined = "combined1_" + to_string(i) + ".ppm", desert = "desert_" + to_string(i) + ".sbu";
+        check_image_file_contents("./tests/expected_outputs/combined1.ppm", actual_output(combined.c_str()));
+        check_image_file_contents("./tests/expected_outputs/desert.sbu", actual_output(desert.c_str()));
+    }
+}
@@ -10,20 +10,18 @@ using namespace std;
 
 class image_operations_TestSuite : public testing::Test { 
 	void SetUp() override {
-        system("rm -rf ./tests/actual_outputs");
-        system("rm -f /tmp/exp_single_line.txt and /tmp/act_single_line.txt");
-		mkdir("./tests/actual_outputs/", 0700);
+		prepare_output_dir();
 	}
 };
 
-extern char cmd[300];
+extern char cmd[1024];
 
 // Load a PPM image and perform a copy and paste operation
 TEST_F(image_operations_TestSuite, copy_paste_cactus) {
     const char *input_file = "./tests/images/desert.ppm";
     const char *expected_output_file = "./tests/expected_outputs/cactus.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -c 90,10,50,100 -i %s -o %s -p 90,60", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -c 90,10,50,100 -i %s -o %s -p 90,60", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -34,8 +32,8 @@ TEST_F(image_operations_TestSuite, copy_paste_cactus) {
 TEST_F(image_operations_TestSuite, copy_paste_cactus_sbu) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/expected_outputs/cactus.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -p 90,60 -c 90,10,50,100 -o %s", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -p 90,60 -c 90,10,50,100 -o %s", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -46,8 +44,8 @@ TEST_F(image_operations_TestSuite, copy_paste_cactus_sbu) {
 TEST_F(image_operations_TestSuite, copy_paste_stony1_1) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/stony1_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -c 5,275,100,75 -p 10,20 -i %s -o %s", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -c 5,275,100,75 -p 10,20 -i %s -o %s", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -58,8 +56,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony1_1) {
 TEST_F(image_operations_TestSuite, copy_paste_stony1_2) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/stony1_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -p 15,20 -c 75,200,300,10 -o %s", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -p 15,20 -c 75,200,300,10 -o %s", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -70,8 +68,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony1_2) {
 TEST_F(image_operations_TestSuite, copy_paste_stony2_1) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/stony2_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -o %s -c 170,100,90,180 -p 0,0 -i %s", actual_output_file, input_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -o %s -c 170,100,90,180 -p 0,0 -i %s", actual_output_file, input_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -82,8 +80,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony2_1) {
 TEST_F(image_operations_TestSuite, copy_paste_stony2_2) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/stony2_2.sbu";
-    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
-    sprintf(cmd, "./build/hw2_main -i %s -p 20,25 -o %s -c 75,200,50,175", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -i %s -p 20,25 -o %s -c 75,200,50,175", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -94,8 +92,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony2_2) {
 TEST_F(image_operations_TestSuite, copy_paste_stony3_1) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/stony3_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -c 120,235,100,150 -o %s -p 20,20", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -c 120,235,100,150 -o %s -p 20,20", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -106,8 +104,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony3_1) {
 TEST_F(image_operations_TestSuite, copy_paste_stony3_2) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/stony3_2.sbu";
-    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
-    sprintf(cmd, "./build/hw2_main -c 120,235,100,150 -i %s -o %s -p 55,65", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -c 120,235,100,150 -i %s -o %s -p 55,65", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -118,8 +116,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony3_2) {
 TEST_F(image_operations_TestSuite, copy_paste_stony4_1) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/stony4_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -c 50,60,200,50 -p 50,170", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -c 50,60,200,50 -p 50,170", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -130,8 +128,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony4_1) {
 TEST_F(image_operations_TestSuite, copy_paste_stony4_2) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/stony4_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -c 25,150,185,125 -o %s -p 50,200", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -c 25,150,185,125 -o %s -p 50,200", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -142,8 +140,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony4_2) {
 TEST_F(image_operations_TestSuite, copy_paste_stony5_1) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/stony5_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -o %s -c 100,100,150,50 -p 180,10 -i %s", actual_output_file, input_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -o %s -c 100,100,150,50 -p 180,10 -i %s", actual_output_file, input_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -154,8 +152,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony5_1) {
 TEST_F(image_operations_TestSuite, copy_paste_stony5_2) {
     const char *input_file = "./tests/images/stony.sbu";
     const char *expected_output_file = "./tests/expected_outputs/stony5_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -o %s -c 100,100,150,50 -i %s -p 180,10", actual_output_file, input_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -o %s -c 100,100,150,50 -i %s -p 180,10", actual_output_file, input_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -166,8 +164,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony5_2) {
 TEST_F(image_operations_TestSuite, copy_paste_stony6_1) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/stony6_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -c 20,25,120,140 -p 100,200", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -c 20,25,120,140 -p 100,200", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -178,8 +176,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony6_1) {
 TEST_F(image_operations_TestSuite, copy_paste_stony6_2) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/stony6_2.sbu";
-    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
-    sprintf(cmd, "./build/hw2_main -p 100,200 -i %s -o %s -c 20,25,120,140", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -p 100,200 -i %s -o %s -c 20,25,120,140", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -190,8 +188,8 @@ TEST_F(image_operations_TestSuite, copy_paste_stony6_2) {
 TEST_F(image_operations_TestSuite, overlapping1) {
     const char *input_file = "./tests/images/stony.ppm";
     const char *expected_output_file = "./tests/expected_outputs/overlapping1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -p 22,32 -o %s -c 20,30,120,140", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -p 22,32 -o %s -c 20,30,120,140", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string>
+#include "gtest/gtest.h"
+#include "tests_aux.h"
+#include "hw2.h"
+
+using namespace std;
+
+// These tests run hw2_main under the libio_counter.so shim (tests/src/io_counter.c), which
+// records how often the input image is opened and how many bytes are read from it. Each
+// run must open the input exactly once and read it at most once.
+class io_counts_TestSuite : public testing::Test {
+	void SetUp() override {
+		prepare_output_dir();
+	}
+};
+
+extern char cmd[1024];
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static void expect_single_read(const char *input_file, const char *args) {
+    const char *counts_file = actual_output("io_counts.txt");
+    assert(file_exists(IO_COUNTER_LIB));
+    sprintf(cmd, "LD_PRELOAD=" IO_COUNTER_LIB " IO_COUNTER_PATH=%s IO_COUNTER_OUT=%s " HW2_MAIN " %s",
+        input_file, counts_file, with_output_dir(args).c_str());
+    INFO(cmd);
+    int status = system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+
+    FILE *file = fopen(counts_file, "r");
+    ASSERT_NE(nullptr, file);
+    int opens = -1;
+    long bytes = -1;
+    EXPECT_EQ(2, fscanf(file, "%d %ld", &opens, &bytes));
+    fclose(file);
+    EXPECT_EQ(1, opens);
+    EXPECT_GT(bytes, 0);
+    EXPECT_LE(bytes, file_size(input_file));
+}
+
+TEST_F(io_counts_TestSuite, load_ppm_once) {
+    expect_single_read("./tests/images/seawolf.ppm", "-i ./tests/images/seawolf.ppm -o $OUT/result.ppm");
+}
+
+TEST_F(io_counts_TestSuite, load_sbu_once) {
+    expect_single_read("./tests/images/desert.sbu", "-i ./tests/images/desert.sbu -o $OUT/result.sbu");
+}
+
+TEST_F(io_counts_TestSuite, load_once_with_copy_paste) {
+    expect_single_read("./tests/images/stony.ppm", "-i ./tests/images/stony.ppm -c 5,275,100,75 -p 10,20 -o $OUT/result.ppm");
+}
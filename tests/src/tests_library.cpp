@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "gtest/gtest.h"
+#include "tests_aux.h"
+#include "hw2.h"
+
+using namespace std;
+
+// Drives the image library in-process, without running hw2_main.
+class library_TestSuite : public testing::Test {
+protected:
+    Image image = {};
+    Image other = {};
+
+    void SetUp() override {
+        prepare_output_dir();
+    }
+    void TearDown() override {
+        free_image(&image);
+        free_image(&other);
+    }
+};
+
+// Save an image as SBU and load it back
+TEST_F(library_TestSuite, sbu_round_trip) {
+    const char *output_file = actual_output("library_round_trip.sbu");
+    ASSERT_EQ(HW2_OK, load_image("./tests/images/desert.ppm", &image, false));
+    ASSERT_EQ(HW2_OK, save_image(output_file, &image, false));
+    ASSERT_EQ(HW2_OK, load_image(output_file, &other, false));
+    ASSERT_EQ(image.width, other.width);
+    ASSERT_EQ(image.height, other.height);
+    EXPECT_EQ(0, memcmp(image.pixels, other.pixels, (size_t)image.width * image.height * sizeof(RGBPixel)));
+}
+
+// Failures come back as error codes with a message instead of being printed
+TEST_F(library_TestSuite, error_codes) {
+    EXPECT_EQ(HW2_ERROR_OPEN, load_image("./tests/images/missing.ppm", &image, false));
+    EXPECT_NE(nullptr, strstr(hw2_error_message(), "Unable to open file"));
+    EXPECT_EQ(HW2_ERROR_FORMAT, load_image("./tests/fonts/font1.txt", &image, false));
+    EXPECT_EQ(HW2_ERROR_FORMAT, load_ppm("./tests/images/desert.sbu", &image, false));
+    EXPECT_EQ(HW2_ERROR_OPEN, save_image("./tests/missing_dir/out.ppm", &image, false));
+    GlyphAtlas atlas;
+    EXPECT_EQ(HW2_ERROR_OPEN, load_glyph_atlas("./tests/fonts/missing.txt", 1, &atlas));
+}
+
+// Palette, copy/paste and rendering on an image built in memory
+TEST_F(library_TestSuite, edit_in_memory) {
+    ASSERT_EQ(HW2_OK, allocate_image(&image, 40, 10));
+    memset(image.pixels, 0, 40 * 10 * sizeof(RGBPixel));
+    image.pixels[0] = RGBPixel{10, 20, 30};
+    image.pixels[1] = RGBPixel{40, 50, 60};
+
+    Rect region = {0, 0, 2, 1};
+    blit_region(&image, region, 9, 38);
+    EXPECT_EQ(40, image.pixels[9 * 40 + 39].r);
+
+    RGBPixel *palette;
+    int paletteSize;
+    ASSERT_EQ(3, calculate_color_palette(&image, &palette, &paletteSize));
+    EXPECT_EQ(3, paletteSize);
+    free(palette);
+
+    GlyphAtlas atlas;
+    ASSERT_EQ(HW2_OK, load_glyph_atlas("./tests/fonts/font1.txt", 1, &atlas));
+    render_text(&image, &atlas, "I", 2, 5);
+    int white = 0;
+    for (int i = 0; i < 40 * 10; i++) white += image.pixels[i].r == 255 && image.pixels[i].g == 255;
+    EXPECT_GT(white, 0);
+    free_glyph_atlas(&atlas);
+}
+
+// Statistics of a load and an SBU save, broken down by stage
+TEST_F(library_TestSuite, stats) {
+    const char *output_file = actual_output("library_stats.sbu");
+    struct stat input;
+    ASSERT_EQ(0, stat("./tests/images/desert.ppm", &input));
+
+    Hw2Stats stats;
+    hw2_stats_start(&stats);
+    ASSERT_EQ(HW2_OK, load_image("./tests/images/desert.ppm", &image, false));
+    ASSERT_EQ(HW2_OK, save_image(output_file, &image, false));
+    hw2_stats_stop();
+
+    struct stat output;
+    ASSERT_EQ(0, stat(output_file, &output));
+    EXPECT_EQ((uint64_t)input.st_size, stats.bytesRead);
+    EXPECT_EQ((uint64_t)output.st_size, stats.bytesWritten);
+    EXPECT_EQ((uint64_t)image.width * image.height, stats.pixels);
+    EXPECT_GT(stats.paletteSize, 0);
+    EXPECT_GT(stats.rleRuns, 0u);
+    EXPECT_GT(stats.peakHeapBytes, (size_t)image.width * image.height * sizeof(RGBPixel));
+    EXPECT_GT(stats.wallSeconds[HW2_STAGE_LOAD], 0.0);
+    EXPECT_GT(stats.cpuSeconds[HW2_STAGE_PALETTE], 0.0);
+    EXPECT_EQ(0.0, stats.wallSeconds[HW2_STAGE_RENDER]);
+
+    // Nothing is collected once stopped.
+    EXPECT_EQ(HW2_STAGE_NONE, hw2_stats_stage(HW2_STAGE_LOAD));
+    ASSERT_EQ(HW2_OK, load_image("./tests/images/desert.ppm", &other, false));
+    EXPECT_EQ((uint64_t)input.st_size, stats.bytesRead);
+}
+
+// With an arena the pixels, color table and palette of a job come from it, and the next job
+// reuses its memory after a release
+TEST_F(library_TestSuite, arena_reuse) {
+    Arena arena = {};
+    image.arena = &arena;
+    ASSERT_EQ(HW2_OK, load_image("./tests/images/desert.sbu", &image, false));
+    RGBPixel *pixels = image.pixels;
+    RGBPixel *palette;
+    int paletteSize;
+    ASSERT_GT(calculate_color_palette(&image, &palette, &paletteSize), 0);
+
+    release_image(&image);
+    release_arena(&arena);
+    ASSERT_EQ(HW2_OK, load_image("./tests/images/desert.sbu", &image, false));
+    EXPECT_EQ(pixels, image.pixels);
+    ASSERT_EQ(HW2_OK, load_ppm("./tests/images/desert.ppm", &other, false));
+    EXPECT_EQ(0, memcmp(image.pixels, other.pixels, (size_t)image.width * image.height * sizeof(RGBPixel)));
+
+    release_image(&image);
+    image.arena = NULL;
+    free_arena(&arena);
+    EXPECT_EQ(nullptr, arena.small);
+    EXPECT_EQ(nullptr, arena.large);
+    EXPECT_EQ(nullptr, arena.children);
+}
@@ -10,20 +10,18 @@ using namespace std;
 
 class image_operations_TestSuite : public testing::Test { 
 	void SetUp() override {
-        system("rm -rf ./tests/actual_outputs");
-        system("rm -f /tmp/exp_single_line.txt and /tmp/act_single_line.txt");
-		mkdir("./tests/actual_outputs/", 0700);
+		prepare_output_dir();
 	}
 };
 
-extern char cmd[300];
+extern char cmd[1024];
 
 // Load PPM image and copy it to PPM
 TEST_F(image_operations_TestSuite, load_ppm_save_ppm) {
     const char *input_file = "./tests/images/seawolf.ppm";
     const char *expected_output_file = "./tests/images/seawolf.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s", input_file, actual_output_file);
     INFO(cmd);
 	int status = run_using_system(cmd);
 	EXPECT_EQ(0, WEXITSTATUS(status));
@@ -34,20 +32,23 @@ TEST_F(image_operations_TestSuite, load_ppm_save_ppm) {
 TEST_F(image_operations_TestSuite, load_ppm_save_sbu) {
     const char *input_file = "./tests/images/seawolf.ppm";
     const char *expected_output_file = "./tests/images/seawolf.sbu";
-    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
-    sprintf(cmd, "./build/hw2_main -o %s -i %s", actual_output_file, input_file);
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -o %s -i %s", actual_output_file, input_file);
     INFO(cmd);
 	int status = run_using_system(cmd);
 	EXPECT_EQ(0, WEXITSTATUS(status));
     check_image_file_contents(expected_output_file, actual_output_file);
+    // Palette order and run encoding are part of the format, so the bytes must match too.
+    sprintf(cmd, "cmp -s %s %s", expected_output_file, actual_output_file);
+    EXPECT_EQ(0, WEXITSTATUS(system(cmd))) << actual_output_file << " differs from " << expected_output_file;
 }
 
 // Load SBU image and copy it to SBU
 TEST_F(image_operations_TestSuite, load_sbu_save_sbu) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/images/desert.sbu";
-    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s", input_file, actual_output_file);
     INFO(cmd);
 	int status = run_using_system(cmd);
 	EXPECT_EQ(0, WEXITSTATUS(status));
@@ -58,10 +59,172 @@ TEST_F(image_operations_TestSuite, load_sbu_save_sbu) {
 TEST_F(image_operations_TestSuite, load_sbu_save_ppm) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/images/desert.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -o %s -i %s", actual_output_file, input_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -o %s -i %s", actual_output_file, input_file);
     INFO(cmd);
 	int status = run_using_system(cmd);
 	EXPECT_EQ(0, WEXITSTATUS(status));
     check_image_file_contents(expected_output_file, actual_output_file);
 }
+
+// Convert an image with far more than 256 colors to SBU; indexes must not be truncated
+TEST_F(image_operations_TestSuite, load_ppm_save_sbu_large_palette) {
+    const char *input_file = "./tests/images/stony.ppm";
+    const char *expected_output_file = "./tests/images/stony.sbu";
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+    sprintf(cmd, "cmp -s %s %s", expected_output_file, actual_output_file);
+    EXPECT_EQ(0, WEXITSTATUS(system(cmd))) << actual_output_file << " differs from " << expected_output_file;
+}
+
+// Convert PPM to binary P6 with -b and back to plain P3
+TEST_F(image_operations_TestSuite, load_ppm_save_raw_ppm) {
+    const char *input_file = "./tests/images/stony.ppm";
+    const char *expected_output_file = "./tests/images/stony.ppm";
+    const char *raw_output_file = actual_output("result_raw.ppm");
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -b", input_file, raw_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, HW2_MAIN " -i %s -o %s", raw_output_file, actual_output_file);
+    INFO(cmd);
+	status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Load a plain PPM large enough to be parsed by several threads and save it as binary P6
+TEST_F(image_operations_TestSuite, load_large_ppm_save_raw_ppm) {
+    const int width = 1700, height = 1200;
+    const char *input_file = actual_output("large.ppm");
+    const char *actual_output_file = actual_output("result.ppm");
+    FILE *fp = fopen(input_file, "w");
+    ASSERT_NE(nullptr, fp);
+    fprintf(fp, "P3\n%d %d\n255\n", width, height);
+    for (int i = 0; i < width * height * 3; i++) fprintf(fp, i % 17 == 16 ? "%d\n" : "%d ", (i * 7 + i / 1013) % 256);
+    fclose(fp);
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -b", input_file, actual_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    fp = fopen(actual_output_file, "rb");
+    ASSERT_NE(nullptr, fp);
+    int w = 0, h = 0, max = 0;
+    EXPECT_EQ(3, fscanf(fp, "P6 %d %d %d", &w, &h, &max));
+    EXPECT_EQ(width, w);
+    EXPECT_EQ(height, h);
+    fgetc(fp);
+    std::string pixels(width * height * 3, '\0');
+    EXPECT_EQ(pixels.size(), fread(&pixels[0], 1, pixels.size(), fp));
+    fclose(fp);
+    for (int i = 0; i < width * height * 3; i++) {
+        if ((unsigned char)pixels[i] != (i * 7 + i / 1013) % 256) {
+            ADD_FAILURE() << "component " << i << " differs";
+            break;
+        }
+    }
+}
+
+// Save a large image with many colors and long runs as SBU, then convert it back
+TEST_F(image_operations_TestSuite, load_large_raw_ppm_save_sbu) {
+    const int width = 1500, height = 1500;
+    const char *input_file = actual_output("large.ppm");
+    const char *sbu_output_file = actual_output("result.sbu");
+    const char *actual_output_file = actual_output("result.ppm");
+    std::string pixels(width * height * 3, '\0');
+    for (int i = 0; i < width * height; i++) {
+        int color = (i / 37) % 5000;
+        pixels[i * 3] = (char)(color % 256);
+        pixels[i * 3 + 1] = (char)(color / 256);
+        pixels[i * 3 + 2] = (char)(i / (width * 100));
+    }
+    FILE *fp = fopen(input_file, "wb");
+    ASSERT_NE(nullptr, fp);
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    fwrite(pixels.data(), 1, pixels.size(), fp);
+    fclose(fp);
+    sprintf(cmd, HW2_MAIN " -i %s -o %s", input_file, sbu_output_file);
+    INFO(cmd);
+    int status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -b", sbu_output_file, actual_output_file);
+    INFO(cmd);
+    status = run_using_system(cmd);
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    sprintf(cmd, "cmp -s %s %s", input_file, actual_output_file);
+    EXPECT_EQ(0, WEXITSTATUS(system(cmd)));
+}
+
+// Reject SBU files whose index stream is truncated, out of range or overruns the image
+TEST_F(image_operations_TestSuite, load_malformed_sbu) {
+    const char *input_file = actual_output("malformed.sbu");
+    const char *output_file = actual_output("malformed.ppm");
+    const char *streams[] = {"0 1 0", "0 1 3 0", "*2 0 *2 3", "*3 1 *2 0", "0 *2", "1 x 0 1"};
+    for (const char *stream : streams) {
+        FILE *fp = fopen(input_file, "w");
+        ASSERT_NE(nullptr, fp);
+        fprintf(fp, "SBU\n2 2\n3\n1 2 3 4 5 6 7 8 9\n%s\n", stream);
+        fclose(fp);
+        sprintf(cmd, HW2_MAIN " -i %s -o %s", input_file, output_file);
+        INFO(stream);
+        int status = run_using_system(cmd);
+        EXPECT_EQ(1, WEXITSTATUS(status));
+    }
+}
+
+// Stream a PPM image to SBU a band of rows at a time with -s
+TEST_F(image_operations_TestSuite, stream_ppm_save_sbu) {
+    const char *input_file = "./tests/images/stony.ppm";
+    const char *expected_output_file = "./tests/images/stony.sbu";
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -s -i %s -o %s", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+    sprintf(cmd, "cmp -s %s %s", expected_output_file, actual_output_file);
+    EXPECT_EQ(0, WEXITSTATUS(system(cmd))) << actual_output_file << " differs from " << expected_output_file;
+}
+
+// Stream an SBU image to PPM a band of rows at a time with -s
+TEST_F(image_operations_TestSuite, stream_sbu_save_ppm) {
+    const char *input_file = "./tests/images/desert.sbu";
+    const char *expected_output_file = "./tests/images/desert.ppm";
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -s -o %s", input_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Stream an SBU image over itself with -s; the input must survive until the output replaces it
+TEST_F(image_operations_TestSuite, stream_same_file) {
+    const char *expected_output_file = "./tests/images/desert.sbu";
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, "cp %s %s", expected_output_file, actual_output_file);
+    ASSERT_EQ(0, WEXITSTATUS(system(cmd)));
+    sprintf(cmd, HW2_MAIN " -s -i %s -o %s", actual_output_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(expected_output_file, actual_output_file);
+}
+
+// Save a raw PPM over the file it was mapped from; the pixels must be copied out first
+TEST_F(image_operations_TestSuite, save_raw_ppm_same_file) {
+    const char *input_file = "./tests/images/stony.ppm";
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -b", input_file, actual_output_file);
+    ASSERT_EQ(0, WEXITSTATUS(run_using_system(cmd)));
+    sprintf(cmd, HW2_MAIN " -i %s -o %s", actual_output_file, actual_output_file);
+    INFO(cmd);
+	int status = run_using_system(cmd);
+	EXPECT_EQ(0, WEXITSTATUS(status));
+    check_image_file_contents(input_file, actual_output_file);
+}
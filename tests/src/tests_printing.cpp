@@ -10,20 +10,18 @@ using namespace std;
 
 class image_operations_TestSuite : public testing::Test { 
 	void SetUp() override {
-        system("rm -rf ./tests/actual_outputs");
-        system("rm -f /tmp/exp_single_line.txt and /tmp/act_single_line.txt");
-		mkdir("./tests/actual_outputs/", 0700);
+		prepare_output_dir();
 	}
 };
 
-extern char cmd[300];
+extern char cmd[1024];
 
 // Print a short message that fits entirely in the image
 TEST_F(image_operations_TestSuite, print_short_message1_1) {
     const char *input_file = "./tests/images/desert.ppm";
     const char *expected_output_file = "./tests/expected_outputs/desert_short_message1_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"seawolves\",\"./tests/fonts/font1.txt\",1,100,150", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"seawolves\",\"./tests/fonts/font1.txt\",1,100,150", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -34,8 +32,8 @@ TEST_F(image_operations_TestSuite, print_short_message1_1) {
 TEST_F(image_operations_TestSuite, print_short_message1_2) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/expected_outputs/desert_short_message1_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -r \"seawolves\",\"./tests/fonts/font1.txt\",1,100,150 -o %s", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -r \"seawolves\",\"./tests/fonts/font1.txt\",1,100,150 -o %s", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -46,8 +44,8 @@ TEST_F(image_operations_TestSuite, print_short_message1_2) {
 TEST_F(image_operations_TestSuite, print_short_message2_1) {
     const char *input_file = "./tests/images/desert.ppm";
     const char *expected_output_file = "./tests/expected_outputs/desert_short_message2_1.sbu";
-    const char *actual_output_file = "./tests/actual_outputs/result.sbu";
-    sprintf(cmd, "./build/hw2_main -o %s -r \"stONY brOOK desert\",\"./tests/fonts/font2.txt\",1,60,45 -i %s", actual_output_file, input_file);
+    const char *actual_output_file = actual_output("result.sbu");
+    sprintf(cmd, HW2_MAIN " -o %s -r \"stONY brOOK desert\",\"./tests/fonts/font2.txt\",1,60,45 -i %s", actual_output_file, input_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -58,8 +56,8 @@ TEST_F(image_operations_TestSuite, print_short_message2_1) {
 TEST_F(image_operations_TestSuite, print_short_message2_2) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/expected_outputs/desert_short_message2_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"stONY brOOK\",\"./tests/fonts/font2.txt\",1,60,100", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"stONY brOOK\",\"./tests/fonts/font2.txt\",1,60,100", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -70,8 +68,8 @@ TEST_F(image_operations_TestSuite, print_short_message2_2) {
 TEST_F(image_operations_TestSuite, print_overflow_message1_1) {
     const char *input_file = "./tests/images/desert.ppm";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message1_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font3.txt\",1,10,220", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font3.txt\",1,10,220", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -82,8 +80,8 @@ TEST_F(image_operations_TestSuite, print_overflow_message1_1) {
 TEST_F(image_operations_TestSuite, print_overflow_message1_2) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message1_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font3.txt\",1,10,220", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font3.txt\",1,10,220", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -94,8 +92,8 @@ TEST_F(image_operations_TestSuite, print_overflow_message1_2) {
 TEST_F(image_operations_TestSuite, print_overflow_message2_1) {
     const char *input_file = "./tests/images/desert.ppm";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message2_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font4.txt\",1,10,200", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font4.txt\",1,10,200", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -106,8 +104,8 @@ TEST_F(image_operations_TestSuite, print_overflow_message2_1) {
 TEST_F(image_operations_TestSuite, print_overflow_message2_2) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message2_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font4.txt\",1,10,200", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font4.txt\",1,10,200", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -118,8 +116,8 @@ TEST_F(image_operations_TestSuite, print_overflow_message2_2) {
 TEST_F(image_operations_TestSuite, print_overflow_message3_1) {
     const char *input_file = "./tests/images/desert.ppm";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message3_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font1.txt\",2,40,180", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font1.txt\",2,40,180", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -130,8 +128,8 @@ TEST_F(image_operations_TestSuite, print_overflow_message3_1) {
 TEST_F(image_operations_TestSuite, print_overflow_message3_2) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message3_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font1.txt\",2,40,180", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font1.txt\",2,40,180", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -142,8 +140,8 @@ TEST_F(image_operations_TestSuite, print_overflow_message3_2) {
 TEST_F(image_operations_TestSuite, print_overflow_message4_1) {
     const char *input_file = "./tests/images/desert.ppm";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message4_1.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"seawolves\",\"./tests/fonts/font2.txt\",3,10,180", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"seawolves\",\"./tests/fonts/font2.txt\",3,10,180", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
@@ -154,10 +152,25 @@ TEST_F(image_operations_TestSuite, print_overflow_message4_1) {
 TEST_F(image_operations_TestSuite, print_overflow_message4_2) {
     const char *input_file = "./tests/images/desert.sbu";
     const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message4_2.ppm";
-    const char *actual_output_file = "./tests/actual_outputs/result.ppm";
-    sprintf(cmd, "./build/hw2_main -i %s -o %s -r \"seawolves\",\"./tests/fonts/font2.txt\",3,10,180", input_file, actual_output_file);
+    const char *actual_output_file = actual_output("result.ppm");
+    sprintf(cmd, HW2_MAIN " -i %s -o %s -r \"seawolves\",\"./tests/fonts/font2.txt\",3,10,180", input_file, actual_output_file);
     INFO(cmd);
     int status = run_using_system(cmd);
     EXPECT_EQ(0, WEXITSTATUS(status));
     check_image_file_contents(expected_output_file, actual_output_file);
-}
\ No newline at end of file
+}
+// Render the same message twice; the second run must come out the same when its glyphs are
+// read back from the font cache
+TEST_F(image_operations_TestSuite, print_cached_font) {
+    const char *input_file = "./tests/images/desert.ppm";
+    const char *expected_output_file = "./tests/expected_outputs/desert_overflow_message2_1.ppm";
+    const char *actual_output_file = actual_output("result.ppm");
+    for (int run = 0; run < 2; run++) {
+        sprintf(cmd, "HW2_FONT_CACHE_DIR=%s " HW2_MAIN " -i %s -o %s -r \"new YORK state\",\"./tests/fonts/font4.txt\",1,10,200", with_output_dir("$OUT").c_str(), input_file, actual_output_file);
+        INFO(cmd);
+        int status = system(cmd);
+        EXPECT_EQ(0, WEXITSTATUS(status));
+        check_image_file_contents(expected_output_file, actual_output_file);
+    }
+    EXPECT_EQ(0, WEXITSTATUS(system(with_output_dir("ls $OUT/*.atlas > /dev/null").c_str())));
+}
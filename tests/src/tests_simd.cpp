@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "hw2_simd.h"
+
+using namespace std;
+
+// Every kernel level the CPU supports must reproduce the scalar kernels exactly.
+class simd_TestSuite : public testing::TestWithParam<int> {
+protected:
+    void SetUp() override {
+        srand(12345);
+        if (hw2_simd_set_level(GetParam()) != GetParam()) GTEST_SKIP() << "kernel level not supported";
+    }
+    void TearDown() override {
+        hw2_simd_set_level(HW2_SIMD_AVX2);
+    }
+};
+
+static vector<unsigned char> random_pixels(size_t count, int colors) {
+    vector<unsigned char> pixels(count * 3 + 1);
+    for (size_t i = 0; i < count; i++) {
+        int color = rand() % colors;
+        pixels[i * 3] = (unsigned char)(color * 37);
+        pixels[i * 3 + 1] = (unsigned char)(color * 11);
+        pixels[i * 3 + 2] = (unsigned char)color;
+    }
+    return pixels;
+}
+
+TEST_P(simd_TestSuite, run_length) {
+    for (size_t count = 1; count < 300; count++) {
+        for (size_t run = 1; run <= count; run += 1 + run / 4) {
+            vector<unsigned char> pixels = random_pixels(count, 5);
+            for (size_t i = 1; i < run; i++) memcpy(&pixels[i * 3], &pixels[0], 3);
+            if (run < count) pixels[run * 3 + 2] = (unsigned char)(pixels[2] + 1);
+            EXPECT_EQ(run, hw2_run_length(pixels.data(), count)) << "count " << count << " run " << run;
+        }
+    }
+}
+
+TEST_P(simd_TestSuite, pack_pixels) {
+    for (size_t count = 0; count < 100; count++) {
+        vector<unsigned char> pixels = random_pixels(count, 1000);
+        vector<uint32_t> keys(count + 1, 0xdeadbeef);
+        hw2_pack_pixels(pixels.data(), keys.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(((uint32_t)pixels[i * 3] << 16) | ((uint32_t)pixels[i * 3 + 1] << 8) | pixels[i * 3 + 2], keys[i]);
+        }
+        EXPECT_EQ(0xdeadbeefu, keys[count]);
+    }
+}
+
+TEST_P(simd_TestSuite, fill_pixels) {
+    const unsigned char colors[][3] = {{255, 255, 255}, {1, 2, 3}, {200, 0, 200}};
+    for (const auto &color : colors) {
+        for (size_t count = 0; count < 100; count++) {
+            vector<unsigned char> pixels(count * 3 + 3, 7);
+            hw2_fill_pixels(pixels.data(), count, color[0], color[1], color[2]);
+            for (size_t i = 0; i < count; i++) {
+                EXPECT_TRUE(pixels[i * 3] == color[0] && pixels[i * 3 + 1] == color[1] && pixels[i * 3 + 2] == color[2]);
+            }
+            EXPECT_EQ(7, pixels[count * 3]);
+        }
+    }
+}
+
+// Random streams of values with varied separators, some with a malformed token planted.
+TEST_P(simd_TestSuite, decode_bytes) {
+    const char *separators[] = {" ", "\n", "  ", "\t", " \r\n"};
+    const char *malformed[] = {"256", "1234", "12x", "x", "-1", "+3"};
+    for (int trial = 0; trial < 400; trial++) {
+        string text;
+        int values = rand() % 60;
+        for (int i = 0; i < values; i++) {
+            if (trial % 3 == 0 && rand() % 40 == 0) text += malformed[rand() % 6];
+            else text += to_string(rand() % (trial % 2 ? 256 : 10));
+            text += separators[rand() % 5];
+        }
+        if (trial % 4 == 0 && !text.empty()) text.pop_back();
+        size_t count = (size_t)(trial % 5 == 0 ? values / 2 : values + 1);
+        vector<unsigned char> expected(count + 1), actual(count + 1);
+        size_t expectedConsumed = 0, actualConsumed = 0;
+        hw2_simd_set_level(HW2_SIMD_SCALAR);
+        size_t expectedDone = hw2_decode_bytes((const unsigned char *)text.data(), text.size(), expected.data(), count, 255, &expectedConsumed);
+        hw2_simd_set_level(GetParam());
+        size_t actualDone = hw2_decode_bytes((const unsigned char *)text.data(), text.size(), actual.data(), count, 255, &actualConsumed);
+        EXPECT_EQ(expectedDone, actualDone) << text;
+        EXPECT_EQ(expectedConsumed, actualConsumed) << text;
+        EXPECT_EQ(expected, actual) << text;
+    }
+}
+
+TEST_P(simd_TestSuite, decode_uints) {
+    const char *malformed[] = {"1000000000", "*", "12*", "x", "5000"};
+    for (int trial = 0; trial < 400; trial++) {
+        string text;
+        int values = rand() % 60;
+        for (int i = 0; i < values; i++) {
+            if (trial % 3 == 0 && rand() % 40 == 0) text += malformed[rand() % 5];
+            else text += to_string(rand() % (trial % 2 ? 4096 : 10));
+            text += rand() % 4 ? " " : "\n";
+        }
+        size_t count = (size_t)(trial % 5 == 0 ? values / 2 : values + 1);
+        vector<uint32_t> expected(count + 1), actual(count + 1);
+        size_t expectedConsumed = 0, actualConsumed = 0;
+        hw2_simd_set_level(HW2_SIMD_SCALAR);
+        size_t expectedDone = hw2_decode_uints((const unsigned char *)text.data(), text.size(), expected.data(), count, 4095, &expectedConsumed);
+        hw2_simd_set_level(GetParam());
+        size_t actualDone = hw2_decode_uints((const unsigned char *)text.data(), text.size(), actual.data(), count, 4095, &actualConsumed);
+        EXPECT_EQ(expectedDone, actualDone) << text;
+        EXPECT_EQ(expectedConsumed, actualConsumed) << text;
+        EXPECT_EQ(expected, actual) << text;
+    }
+
+    const char *runs = "7 123456789 42 *3 9";
+    uint32_t out[5];
+    size_t consumed;
+    EXPECT_EQ(3u, hw2_decode_uints((const unsigned char *)runs, strlen(runs), out, 5, 999999999, &consumed));
+    EXPECT_EQ(123456789u, out[1]);
+    EXPECT_EQ('*', runs[consumed]);
+}
+
+INSTANTIATE_TEST_SUITE_P(levels, simd_TestSuite, testing::Values(HW2_SIMD_SCALAR, HW2_SIMD_SSE2, HW2_SIMD_AVX2));
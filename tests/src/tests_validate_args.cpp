@@ -7,18 +7,24 @@
 
 class validate_args_TestSuite : public testing::Test { 
 	void SetUp() override {
-        system("rm -rf ./tests/actual_outputs");
-		system("rm -f /tmp/exp_single_line.txt and /tmp/act_single_line.txt");
-		mkdir("./tests/actual_outputs/", 0700);
+		prepare_output_dir();
 	}
 };
 
 // Swapping the order of the -i and -o arguments should not matter
 TEST_F(validate_args_TestSuite, acceptable_args) {
-	int status = run_using_system("-o ./tests/actual_outputs/result.sbu -i ./tests/images/seawolf.sbu");
+	int status = run_using_system(with_output_dir("-o $OUT/result.sbu -i ./tests/images/seawolf.sbu").c_str());
 	EXPECT_EQ(0, WEXITSTATUS(status));
 }
 
+// --stats is accepted anywhere on the command line, but only once
+TEST_F(validate_args_TestSuite, stats_arg) {
+	int status = run_using_system(with_output_dir("--stats -i ./tests/images/seawolf.sbu -o $OUT/result.ppm 2>/dev/null").c_str());
+	EXPECT_EQ(0, WEXITSTATUS(status));
+	status = run_using_system(with_output_dir("-i ./tests/images/seawolf.sbu --stats -o $OUT/result.ppm --stats").c_str());
+	EXPECT_EQ(DUPLICATE_ARGUMENT, WEXITSTATUS(status));
+}
+
 // -o argument is missing
 TEST_F(validate_args_TestSuite, missing_o_arg) {
 	int status = run_using_system("-i ./tests/images/seawolf.ppm -r \"I love SBU\",\"fonts/font3.txt\",1,4,2");
@@ -33,42 +39,43 @@ TEST_F(validate_args_TestSuite, missing_i_arg) {
 
 // Unrecognized argument and parameter are provided.
 TEST_F(validate_args_TestSuite, unrecog_arg01) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -j 77 -o ./tests/actual_outputs/result.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -j 77 -o $OUT/result.ppm").c_str());
 	EXPECT_EQ(UNRECOGNIZED_ARGUMENT, WEXITSTATUS(status));
 }
 
 // UNRECOGNIZED_ARGUMENT takes precedence over DUPLICATE_ARGUMENT
 TEST_F(validate_args_TestSuite, unrecog_arg02) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -o ./tests/actual_outputs/result1.ppm -k 100 -o ./tests/actual_outputs/result2.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -o $OUT/result1.ppm -k 100 -o $OUT/result2.ppm").c_str());
 	EXPECT_EQ(UNRECOGNIZED_ARGUMENT, WEXITSTATUS(status));
 }
 
 // -o argument provided twice
 TEST_F(validate_args_TestSuite, duplicate_arg01) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -o ./tests/actual_outputs/result1.ppm -o ./tests/actual_outputs/result2.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -o $OUT/result1.ppm -o $OUT/result2.ppm").c_str());
 	EXPECT_EQ(DUPLICATE_ARGUMENT, WEXITSTATUS(status));
 }
 
 // -i argument provided twice
 TEST_F(validate_args_TestSuite, duplicate_arg02) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -o ./tests/actual_outputs/result1.ppm -i ./tests/images/seawolf.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -o $OUT/result1.ppm -i ./tests/images/seawolf.ppm").c_str());
 	EXPECT_EQ(DUPLICATE_ARGUMENT, WEXITSTATUS(status));
 }
 
 // Input file is missing
 TEST_F(validate_args_TestSuite, input_missing) {
-	int status = run_using_system("-i ./tests/images/garbage.ppm -o ./tests/actual_outputs/result1.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/garbage.ppm -o $OUT/result1.ppm").c_str());
 	EXPECT_EQ(INPUT_FILE_MISSING, WEXITSTATUS(status));
 }
 
 // DUPLICATE_ARGUMENT takes precedence over INPUT_FILE_MISSING
 TEST_F(validate_args_TestSuite, duplicate_arg03) {
-	int status = run_using_system("-i ./tests/images/garbage.ppm -o ./tests/actual_outputs/result1.ppm -i ./tests/images/garbage.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/garbage.ppm -o $OUT/result1.ppm -i ./tests/images/garbage.ppm").c_str());
 	EXPECT_EQ(DUPLICATE_ARGUMENT, WEXITSTATUS(status));
 }
 
 // Output file cannot be written
 TEST_F(validate_args_TestSuite, unwriteable_file01) {
+	if (geteuid() == 0) GTEST_SKIP() << "root can write to /";
 	int status = run_using_system("-i ./tests/images/seawolf.ppm -o /result1.ppm");
 	EXPECT_EQ(OUTPUT_FILE_UNWRITABLE, WEXITSTATUS(status));
 }
@@ -93,37 +100,37 @@ TEST_F(validate_args_TestSuite, missing_parameter02) {
 
 // -r argument is missing its parameter
 TEST_F(validate_args_TestSuite, missing_parameter03) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -r -o ./tests/actual_outputs/result1.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -r -o $OUT/result1.ppm").c_str());
 	EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
 }
 
 // -i argument is missing its parameter
 TEST_F(validate_args_TestSuite, missing_parameter04) {
-	int status = run_using_system("-i -p 10,20 -o ./tests/actual_outputs/result1.ppm");
+	int status = run_using_system(with_output_dir("-i -p 10,20 -o $OUT/result1.ppm").c_str());
 	EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
 }
 
 // -p argument is given without -c parameter
 TEST_F(validate_args_TestSuite, missing_c_arg) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10,20 -o ./tests/actual_outputs/result1.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p 10,20 -o $OUT/result1.ppm").c_str());
 	EXPECT_EQ(C_ARGUMENT_MISSING, WEXITSTATUS(status));
 }
 
 // MISSING_ARGUMENT takes precedence over C_ARGUMENT_MISSING
 TEST_F(validate_args_TestSuite, missing_parameter05) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p -o ./tests/actual_outputs/result1.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p -o $OUT/result1.ppm").c_str());
 	EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
 }
 
 // MISSING_ARGUMENT takes precedence over C_ARGUMENT_MISSING
 TEST_F(validate_args_TestSuite, missing_parameter06) {
-	int status = run_using_system("-r -i ./tests/images/seawolf.ppm -p 10,20 -o ./tests/actual_outputs/result1.ppm");
+	int status = run_using_system(with_output_dir("-r -i ./tests/images/seawolf.ppm -p 10,20 -o $OUT/result1.ppm").c_str());
 	EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
 }
 
 // MISSING_ARGUMENT takes precedence over C_ARGUMENT_MISSING
 TEST_F(validate_args_TestSuite, missing_parameter07) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10,20 -o ./tests/actual_outputs/result1.ppm -r");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p 10,20 -o $OUT/result1.ppm -r").c_str());
 	EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
 }
 
@@ -135,54 +142,54 @@ TEST_F(validate_args_TestSuite, missing_parameter08) {
 
 // -c argument is missing an input value.
 TEST_F(validate_args_TestSuite, c_argument_invalid01) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -o ./tests/actual_outputs/result1.ppm -c 12,15,20");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -o $OUT/result1.ppm -c 12,15,20").c_str());
 	EXPECT_EQ(C_ARGUMENT_INVALID, WEXITSTATUS(status));
 }
 
 // -c argument is missing an input value.
 TEST_F(validate_args_TestSuite, c_argument_invalid02) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -o ./tests/actual_outputs/result1.ppm -c 12,15,20,");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -o $OUT/result1.ppm -c 12,15,20,").c_str());
 	EXPECT_EQ(C_ARGUMENT_INVALID, WEXITSTATUS(status));
 }
 
 // -c argument has too many input values.
 TEST_F(validate_args_TestSuite, c_argument_invalid03) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -o ./tests/actual_outputs/result1.ppm -c 12,15,20,30,5");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -o $OUT/result1.ppm -c 12,15,20,30,5").c_str());
 	EXPECT_EQ(C_ARGUMENT_INVALID, WEXITSTATUS(status));
 }
 
 // -p argument is missing an input value.
 TEST_F(validate_args_TestSuite, p_argument_invalid01) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10, -o ./tests/actual_outputs/result1.ppm -c 10,20,30,15");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p 10, -o $OUT/result1.ppm -c 10,20,30,15").c_str());
 	EXPECT_EQ(P_ARGUMENT_INVALID, WEXITSTATUS(status));
 }
 
 // -r argument is given an invalid font file.
 TEST_F(validate_args_TestSuite, r_argument_invalid01) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/fonts200.txt\",1,10,15 -o ./tests/actual_outputs/result1.ppm -c 10,20,30,15");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/fonts200.txt\",1,10,15 -o $OUT/result1.ppm -c 10,20,30,15").c_str());
 	EXPECT_EQ(R_ARGUMENT_INVALID, WEXITSTATUS(status));
 }
 
 // -r argument is missing an input value.
 TEST_F(validate_args_TestSuite, r_argument_invalid02) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/font1.txt\",10,15 -o ./tests/actual_outputs/result1.ppm -c 10,20,30,15");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/font1.txt\",10,15 -o $OUT/result1.ppm -c 10,20,30,15").c_str());
 	EXPECT_EQ(R_ARGUMENT_INVALID, WEXITSTATUS(status));
 }
 
 // -r argument is has too many input values.
 TEST_F(validate_args_TestSuite, r_argument_invalid03) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/font1.txt\",1,10,15,\"oops\" -o ./tests/actual_outputs/result1.ppm -c 10,20,30,15");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/font1.txt\",1,10,15,\"oops\" -o $OUT/result1.ppm -c 10,20,30,15").c_str());
 	EXPECT_EQ(R_ARGUMENT_INVALID, WEXITSTATUS(status));
 }
 
 // MISSING_ARGUMENT takes precedence over R_ARGUMENT_INVALID
 TEST_F(validate_args_TestSuite, missing_parameter09) {
-	int status = run_using_system("-p 10,20 -r \"hello\",\"./tests/fonts/fonts200.txt\",10,15 -o ./tests/actual_outputs/result1.ppm -c 10,20,30,15");
+	int status = run_using_system(with_output_dir("-p 10,20 -r \"hello\",\"./tests/fonts/fonts200.txt\",10,15 -o $OUT/result1.ppm -c 10,20,30,15").c_str());
 	EXPECT_EQ(MISSING_ARGUMENT, WEXITSTATUS(status));
 }
 
 // MISSING_ARGUMENT takes precedence over R_ARGUMENT_INVALID
 TEST_F(validate_args_TestSuite, missing_parameter10) {
-	int status = run_using_system("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/fonts200.txt\",10,15 -o ./tests/actual_outputs/result1.ppm");
+	int status = run_using_system(with_output_dir("-i ./tests/images/seawolf.ppm -p 10,20 -r \"hello\",\"./tests/fonts/fonts200.txt\",10,15 -o $OUT/result1.ppm").c_str());
 	EXPECT_EQ(C_ARGUMENT_MISSING, WEXITSTATUS(status));
 }
\ No newline at end of file